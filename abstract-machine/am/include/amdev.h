@@ -31,6 +31,11 @@ AM_DEVREG(21, NET_CONFIG,   RD, bool present);
 AM_DEVREG(22, NET_STATUS,   RD, int rx_len, tx_len);
 AM_DEVREG(23, NET_TX,       WR, Area buf);
 AM_DEVREG(24, NET_RX,       WR, Area buf);
+AM_DEVREG(25, DMA_CONFIG,   RD, bool present);
+AM_DEVREG(26, DMA_COPY,     WR, void *dst; const void *src; size_t size);
+AM_DEVREG(27, DMA_FILL,     WR, void *dst; int val; size_t size);
+AM_DEVREG(28, PERF_CONFIG,  RD, bool present);
+AM_DEVREG(29, PERF_COUNTER, RD, uint64_t inst, load, store, branch, mmio);
 
 // Input
 
@@ -29,6 +29,8 @@ void __am_disk_config(AM_DISK_CONFIG_T *cfg);
 void __am_disk_status(AM_DISK_STATUS_T *stat);
 void __am_disk_blkio(AM_DISK_BLKIO_T *io);
 static void __am_net_config (AM_NET_CONFIG_T *cfg)    { cfg->present = false; }
+static void __am_dma_config (AM_DMA_CONFIG_T *cfg)    { cfg->present = false; }
+static void __am_perf_config(AM_PERF_CONFIG_T *cfg)   { cfg->present = false; }
 
 typedef void (*handler_t)(void *buf);
 static void *lut[128] = {
@@ -51,6 +53,8 @@ static void *lut[128] = {
   [AM_DISK_STATUS ] = __am_disk_status,
   [AM_DISK_BLKIO  ] = __am_disk_blkio,
   [AM_NET_CONFIG  ] = __am_net_config,
+  [AM_DMA_CONFIG  ] = __am_dma_config,
+  [AM_PERF_CONFIG ] = __am_perf_config,
 };
 
 bool ioe_init() {
@@ -32,16 +32,36 @@
 #define VGACTL_ADDR     (DEVICE_BASE + 0x0000100)
 #define AUDIO_ADDR      (DEVICE_BASE + 0x0000200)
 #define DISK_ADDR       (DEVICE_BASE + 0x0000300)
+#define DMA_ADDR        (DEVICE_BASE + 0x0000400)
+#define NIC_ADDR        (DEVICE_BASE + 0x0000500)
+#define PERF_ADDR       (DEVICE_BASE + 0x0000600)
+#define DEVLIST_ADDR    (DEVICE_BASE + 0x0000700)
+#define VIRTIO_BLK_ADDR     (MMIO_BASE + 0x0001000)
+#define VIRTIO_CONSOLE_ADDR (MMIO_BASE + 0x0001200)
 #define FB_ADDR         (MMIO_BASE   + 0x1000000)
 #define AUDIO_SBUF_ADDR (MMIO_BASE   + 0x1200000)
 
+// bits of the device list, set for the devices NEMU is built with
+#define DEV_SERIAL   0x001
+#define DEV_TIMER    0x002
+#define DEV_KEYBOARD 0x004
+#define DEV_VGA      0x008
+#define DEV_AUDIO    0x010
+#define DEV_DISK     0x020
+#define DEV_SDCARD   0x040
+#define DEV_VIRTIO   0x080
+#define DEV_DMA      0x100
+#define DEV_NIC      0x200
+#define DEV_PERF     0x400
+#define nemu_has(dev) ((inl(DEVLIST_ADDR) & (dev)) != 0)
+
 extern char _pmem_start;
 #define PMEM_SIZE (128 * 1024 * 1024)
 #define PMEM_END  ((uintptr_t)&_pmem_start + PMEM_SIZE)
 #define NEMU_PADDR_SPACE \
   RANGE(&_pmem_start, PMEM_END), \
   RANGE(FB_ADDR, FB_ADDR + 0x200000), \
-  RANGE(MMIO_BASE, MMIO_BASE + 0x1000) /* serial, rtc, screen, keyboard */
+  RANGE(MMIO_BASE, MMIO_BASE + 0x2000) /* serial, rtc, screen, keyboard, dma, nic, perf, virtio */
 
 typedef uintptr_t PTE;
 
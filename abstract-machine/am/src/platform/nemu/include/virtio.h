@@ -0,0 +1,36 @@
+#ifndef NEMU_VIRTIO_H__
+#define NEMU_VIRTIO_H__
+
+#include <am.h>
+#include <nemu.h>
+
+// Minimal driver side of the virtio-mmio transport of NEMU. NEMU has no
+// interrupt controller, so completions are found by polling the used ring.
+
+#define VIRTQ_NUM 8
+
+#define VIRTQ_DESC_F_NEXT  1
+#define VIRTQ_DESC_F_WRITE 2
+
+struct virtq_desc {
+  uint64_t addr;
+  uint32_t len;
+  uint16_t flags, next;
+};
+
+typedef struct {
+  struct virtq_desc desc[VIRTQ_NUM];
+  struct { uint16_t flags, idx, ring[VIRTQ_NUM]; } avail;
+  struct { uint16_t flags, idx; struct { uint32_t id, len; } ring[VIRTQ_NUM]; } used;
+  uintptr_t base;
+  int q;
+  uint16_t last_used;
+} __attribute__((aligned(16))) VirtQueue;
+
+bool virtio_init(uintptr_t base, uint32_t device_id);
+void virtio_ready(uintptr_t base);
+void virtq_init(VirtQueue *vq, uintptr_t base, int q);
+void virtq_submit(VirtQueue *vq, int head);
+bool virtq_poll(VirtQueue *vq, uint32_t *id, uint32_t *len);
+
+#endif
@@ -8,19 +8,48 @@
 #define AUDIO_INIT_ADDR      (AUDIO_ADDR + 0x10)
 #define AUDIO_COUNT_ADDR     (AUDIO_ADDR + 0x14)
 
+// The stream buffer is a ring. We keep the write position here, fill the
+// free space, then commit the filled bytes by writing their number to
+// AUDIO_COUNT_ADDR. Reading AUDIO_COUNT_ADDR returns the pending bytes.
+static bool present = false;
+static uint32_t sbuf_size = 0;
+static uint32_t sbuf_pos = 0;
+
 void __am_audio_init() {
+  present = nemu_has(DEV_AUDIO);
+  if (present) sbuf_size = inl(AUDIO_SBUF_SIZE_ADDR);
 }
 
 void __am_audio_config(AM_AUDIO_CONFIG_T *cfg) {
-  cfg->present = false;
+  cfg->present = present;
+  cfg->bufsize = sbuf_size;
 }
 
 void __am_audio_ctrl(AM_AUDIO_CTRL_T *ctrl) {
+  outl(AUDIO_FREQ_ADDR, ctrl->freq);
+  outl(AUDIO_CHANNELS_ADDR, ctrl->channels);
+  outl(AUDIO_SAMPLES_ADDR, ctrl->samples);
+  outl(AUDIO_INIT_ADDR, 1);
+  sbuf_pos = 0;
 }
 
 void __am_audio_status(AM_AUDIO_STATUS_T *stat) {
-  stat->count = 0;
+  stat->count = inl(AUDIO_COUNT_ADDR);
 }
 
 void __am_audio_play(AM_AUDIO_PLAY_T *ctl) {
+  uint8_t *src = ctl->buf.start;
+  uint32_t len = (uint8_t *)ctl->buf.end - src;
+  while (len > 0) {
+    uint32_t free;
+    while ((free = sbuf_size - inl(AUDIO_COUNT_ADDR)) == 0);
+    uint32_t n = (len < free ? len : free);
+    for (uint32_t i = 0; i < n; i ++) {
+      outb(AUDIO_SBUF_ADDR + sbuf_pos, src[i]);
+      sbuf_pos = (sbuf_pos + 1 == sbuf_size ? 0 : sbuf_pos + 1);
+    }
+    outl(AUDIO_COUNT_ADDR, n);
+    src += n;
+    len -= n;
+  }
 }
@@ -1,12 +1,74 @@
 #include <am.h>
-#include <nemu.h>
+#include <virtio.h>
+
+// virtio block device. A request is a chain of three descriptors: the
+// header, the buffer and the status byte, and the whole transfer takes
+// a single doorbell write. Without a virtio disk, the register-level
+// disk of NEMU is used instead.
+
+#define BLKSZ 512
+#define VIRTIO_ID_BLOCK 2
+#define VIRTIO_BLK_T_IN  0
+#define VIRTIO_BLK_T_OUT 1
+
+#define DISK_PRESENT_ADDR (DISK_ADDR + 0x00)
+#define DISK_NR_BLK_ADDR  (DISK_ADDR + 0x08)
+#define DISK_BLKNO_ADDR   (DISK_ADDR + 0x0c)
+#define DISK_BLKCNT_ADDR  (DISK_ADDR + 0x10)
+#define DISK_BUF_ADDR     (DISK_ADDR + 0x14)
+#define DISK_CMD_ADDR     (DISK_ADDR + 0x18)
+
+#define DISK_CMD_READ  1
+#define DISK_CMD_WRITE 2
+
+static VirtQueue vq;
+static bool present = false, use_virtio = false;
+static uint64_t capacity = 0;
+static struct { uint32_t type, reserved; uint64_t sector; } hdr;
+static volatile uint8_t status;
+
+static void disk_init_reg() {
+  if (!nemu_has(DEV_DISK) || !inl(DISK_PRESENT_ADDR)) return;
+  capacity = inl(DISK_NR_BLK_ADDR);
+  present = true;
+}
+
+void __am_disk_init() {
+  if (nemu_has(DEV_VIRTIO) && virtio_init(VIRTIO_BLK_ADDR, VIRTIO_ID_BLOCK)) {
+    capacity = inl(VIRTIO_BLK_ADDR + 0x100) | ((uint64_t)inl(VIRTIO_BLK_ADDR + 0x104) << 32);
+    virtq_init(&vq, VIRTIO_BLK_ADDR, 0);
+    virtio_ready(VIRTIO_BLK_ADDR);
+    use_virtio = present = (capacity > 0);
+  }
+  if (!use_virtio) disk_init_reg();
+}
 
 void __am_disk_config(AM_DISK_CONFIG_T *cfg) {
-  cfg->present = false;
+  cfg->present = present;
+  cfg->blksz = BLKSZ;
+  cfg->blkcnt = capacity;
 }
 
 void __am_disk_status(AM_DISK_STATUS_T *stat) {
+  stat->ready = true;
 }
 
 void __am_disk_blkio(AM_DISK_BLKIO_T *io) {
+  if (!use_virtio) {
+    // the device copies the blocks to/from the buffer directly
+    outl(DISK_BLKNO_ADDR, io->blkno);
+    outl(DISK_BLKCNT_ADDR, io->blkcnt);
+    outl(DISK_BUF_ADDR, (uintptr_t)io->buf);
+    outl(DISK_CMD_ADDR, io->write ? DISK_CMD_WRITE : DISK_CMD_READ);
+    return;
+  }
+  hdr.type = (io->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN);
+  hdr.sector = io->blkno;
+  status = 0xff;
+  vq.desc[0] = (struct virtq_desc) { (uintptr_t)&hdr, sizeof(hdr), VIRTQ_DESC_F_NEXT, 1 };
+  vq.desc[1] = (struct virtq_desc) { (uintptr_t)io->buf, io->blkcnt * BLKSZ,
+    VIRTQ_DESC_F_NEXT | (io->write ? 0 : VIRTQ_DESC_F_WRITE), 2 };
+  vq.desc[2] = (struct virtq_desc) { (uintptr_t)&status, 1, VIRTQ_DESC_F_WRITE, 0 };
+  virtq_submit(&vq, 0);
+  while (!virtq_poll(&vq, NULL, NULL));
 }
@@ -0,0 +1,43 @@
+#include <am.h>
+#include <klib.h>
+#include <nemu.h>
+
+// DMA copy engine. NEMU performs the whole transfer while handling the
+// write to the GO register, so nothing has to be polled afterwards.
+
+#define DMA_SRC    (DMA_ADDR + 0x00)
+#define DMA_DST    (DMA_ADDR + 0x04)
+#define DMA_LEN    (DMA_ADDR + 0x08)
+#define DMA_OP     (DMA_ADDR + 0x0c)
+#define DMA_GO     (DMA_ADDR + 0x10)
+#define DMA_STATUS (DMA_ADDR + 0x14)
+
+enum { DMA_OP_COPY, DMA_OP_FILL };
+
+static bool dma_start(int op, uintptr_t dst, uintptr_t src, size_t size) {
+  // without the engine, the CPU does the work
+  if (!nemu_has(DEV_DMA)) return false;
+  outl(DMA_SRC, src);
+  outl(DMA_DST, dst);
+  outl(DMA_LEN, size);
+  outl(DMA_OP, op);
+  outl(DMA_GO, 1);
+  return inl(DMA_STATUS) == 0;
+}
+
+void __am_dma_config(AM_DMA_CONFIG_T *cfg) {
+  cfg->present = nemu_has(DEV_DMA);
+}
+
+void __am_dma_copy(AM_DMA_COPY_T *copy) {
+  // ranges the engine rejects (e.g. crossing a region) are copied by the CPU
+  if (!dma_start(DMA_OP_COPY, (uintptr_t)copy->dst, (uintptr_t)copy->src, copy->size)) {
+    memmove(copy->dst, copy->src, copy->size);
+  }
+}
+
+void __am_dma_fill(AM_DMA_FILL_T *fill) {
+  if (!dma_start(DMA_OP_FILL, (uintptr_t)fill->dst, (uint8_t)fill->val, fill->size)) {
+    memset(fill->dst, fill->val, fill->size);
+  }
+}
@@ -14,14 +14,27 @@ void __am_audio_config(AM_AUDIO_CONFIG_T *);
 void __am_audio_ctrl(AM_AUDIO_CTRL_T *);
 void __am_audio_status(AM_AUDIO_STATUS_T *);
 void __am_audio_play(AM_AUDIO_PLAY_T *);
+void __am_disk_init();
 void __am_disk_config(AM_DISK_CONFIG_T *cfg);
 void __am_disk_status(AM_DISK_STATUS_T *stat);
 void __am_disk_blkio(AM_DISK_BLKIO_T *io);
+void __am_uart_init();
+void __am_uart_config(AM_UART_CONFIG_T *cfg);
+void __am_uart_tx(AM_UART_TX_T *uart);
+void __am_uart_rx(AM_UART_RX_T *uart);
+void __am_net_init();
+void __am_net_config(AM_NET_CONFIG_T *cfg);
+void __am_net_status(AM_NET_STATUS_T *stat);
+void __am_net_tx(AM_NET_TX_T *tx);
+void __am_net_rx(AM_NET_RX_T *rx);
+void __am_dma_config(AM_DMA_CONFIG_T *cfg);
+void __am_dma_copy(AM_DMA_COPY_T *copy);
+void __am_dma_fill(AM_DMA_FILL_T *fill);
+void __am_perf_config(AM_PERF_CONFIG_T *cfg);
+void __am_perf_counter(AM_PERF_COUNTER_T *cnt);
 
 static void __am_timer_config(AM_TIMER_CONFIG_T *cfg) { cfg->present = true; cfg->has_rtc = true; }
 static void __am_input_config(AM_INPUT_CONFIG_T *cfg) { cfg->present = true;  }
-static void __am_uart_config(AM_UART_CONFIG_T *cfg)   { cfg->present = false; }
-static void __am_net_config (AM_NET_CONFIG_T *cfg)    { cfg->present = false; }
 
 typedef void (*handler_t)(void *buf);
 static void *lut[128] = {
@@ -34,6 +47,8 @@ static void *lut[128] = {
   [AM_GPU_FBDRAW  ] = __am_gpu_fbdraw,
   [AM_GPU_STATUS  ] = __am_gpu_status,
   [AM_UART_CONFIG ] = __am_uart_config,
+  [AM_UART_TX     ] = __am_uart_tx,
+  [AM_UART_RX     ] = __am_uart_rx,
   [AM_AUDIO_CONFIG] = __am_audio_config,
   [AM_AUDIO_CTRL  ] = __am_audio_ctrl,
   [AM_AUDIO_STATUS] = __am_audio_status,
@@ -42,6 +57,14 @@ static void *lut[128] = {
   [AM_DISK_STATUS ] = __am_disk_status,
   [AM_DISK_BLKIO  ] = __am_disk_blkio,
   [AM_NET_CONFIG  ] = __am_net_config,
+  [AM_NET_STATUS  ] = __am_net_status,
+  [AM_NET_TX      ] = __am_net_tx,
+  [AM_NET_RX      ] = __am_net_rx,
+  [AM_DMA_CONFIG  ] = __am_dma_config,
+  [AM_DMA_COPY    ] = __am_dma_copy,
+  [AM_DMA_FILL    ] = __am_dma_fill,
+  [AM_PERF_CONFIG ] = __am_perf_config,
+  [AM_PERF_COUNTER] = __am_perf_counter,
 };
 
 static void fail(void *buf) { panic("access nonexist register"); }
@@ -52,6 +75,9 @@ bool ioe_init() {
   __am_gpu_init();
   __am_timer_init();
   __am_audio_init();
+  __am_disk_init();
+  __am_uart_init();
+  __am_net_init();
   return true;
 }
 
@@ -0,0 +1,84 @@
+#include <am.h>
+#include <klib.h>
+#include <nemu.h>
+
+// NIC with descriptor rings. Frames to send are copied into a ring slot
+// and the doorbell is rung; if the peer is slow, several frames pile up
+// in the ring and go out with the next doorbell. All RX slots are kept
+// posted, and a slot is posted again once its frame has been read.
+//
+// NET_STATUS reports the length of the next received frame (0 if none)
+// and the number of frames not sent yet. NET_RX copies the next frame
+// into `buf`, truncating it if needed.
+
+#define NIC_STATUS   (NIC_ADDR + 0x00)
+#define NIC_TX_BASE  (NIC_ADDR + 0x04)
+#define NIC_TX_SIZE  (NIC_ADDR + 0x08)
+#define NIC_TX_AVAIL (NIC_ADDR + 0x0c)
+#define NIC_TX_USED  (NIC_ADDR + 0x10)
+#define NIC_RX_BASE  (NIC_ADDR + 0x14)
+#define NIC_RX_SIZE  (NIC_ADDR + 0x18)
+#define NIC_RX_AVAIL (NIC_ADDR + 0x1c)
+#define NIC_RX_USED  (NIC_ADDR + 0x20)
+#define NIC_DOORBELL (NIC_ADDR + 0x24)
+
+#define NR_DESC 16
+#define BUF_SIZE 4096
+
+struct nic_desc { uint32_t addr, len; };
+
+static struct nic_desc txd[NR_DESC], rxd[NR_DESC];
+static uint8_t txbuf[NR_DESC][BUF_SIZE], rxbuf[NR_DESC][BUF_SIZE];
+static uint32_t tx_avail = 0, rx_avail = 0, rx_next = 0;
+static bool present = false;
+
+void __am_net_init() {
+  present = nemu_has(DEV_NIC);
+  if (!present) return;
+  for (int i = 0; i < NR_DESC; i ++) {
+    txd[i] = (struct nic_desc) { (uintptr_t)txbuf[i], 0 };
+    rxd[i] = (struct nic_desc) { (uintptr_t)rxbuf[i], BUF_SIZE };
+  }
+  // the counters are free-running, start from 0 on both sides
+  outl(NIC_TX_BASE, (uintptr_t)txd);
+  outl(NIC_TX_SIZE, NR_DESC);
+  outl(NIC_TX_AVAIL, 0);
+  outl(NIC_TX_USED, 0);
+  outl(NIC_RX_BASE, (uintptr_t)rxd);
+  outl(NIC_RX_SIZE, NR_DESC);
+  outl(NIC_RX_USED, 0);
+  rx_avail = NR_DESC;
+  outl(NIC_RX_AVAIL, rx_avail);
+}
+
+void __am_net_config(AM_NET_CONFIG_T *cfg) {
+  cfg->present = present;
+}
+
+void __am_net_status(AM_NET_STATUS_T *stat) {
+  if (!present) { stat->tx_len = stat->rx_len = 0; return; }
+  outl(NIC_DOORBELL, 1);
+  stat->tx_len = tx_avail - inl(NIC_TX_USED);
+  stat->rx_len = (inl(NIC_RX_USED) != rx_next ? rxd[rx_next % NR_DESC].len : 0);
+}
+
+void __am_net_tx(AM_NET_TX_T *tx) {
+  if (!present) return;
+  size_t len = tx->buf.end - tx->buf.start;
+  if (len > BUF_SIZE) len = BUF_SIZE;
+  while (tx_avail - inl(NIC_TX_USED) == NR_DESC) outl(NIC_DOORBELL, 1);
+  int i = tx_avail % NR_DESC;
+  memcpy(txbuf[i], tx->buf.start, len);
+  txd[i].len = len;
+  outl(NIC_TX_AVAIL, ++ tx_avail);
+  outl(NIC_DOORBELL, 1);
+}
+
+void __am_net_rx(AM_NET_RX_T *rx) {
+  if (!present || inl(NIC_RX_USED) == rx_next) return;
+  int i = rx_next ++ % NR_DESC;
+  size_t len = rx->buf.end - rx->buf.start;
+  memcpy(rx->buf.start, rxbuf[i], (rxd[i].len < len ? rxd[i].len : len));
+  rxd[i].len = BUF_SIZE;
+  outl(NIC_RX_AVAIL, ++ rx_avail);
+}
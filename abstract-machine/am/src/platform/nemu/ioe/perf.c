@@ -0,0 +1,24 @@
+#include <am.h>
+#include <nemu.h>
+
+// Counters maintained by NEMU. Reading the high word of a counter
+// latches it, so the high word is read first.
+
+static uint64_t perf_read(int idx) {
+  if (!nemu_has(DEV_PERF)) return 0;
+  uint32_t hi = inl(PERF_ADDR + idx * 8 + 4);
+  uint32_t lo = inl(PERF_ADDR + idx * 8);
+  return ((uint64_t)hi << 32) | lo;
+}
+
+void __am_perf_config(AM_PERF_CONFIG_T *cfg) {
+  cfg->present = nemu_has(DEV_PERF);
+}
+
+void __am_perf_counter(AM_PERF_COUNTER_T *cnt) {
+  cnt->inst   = perf_read(0);
+  cnt->load   = perf_read(1);
+  cnt->store  = perf_read(2);
+  cnt->branch = perf_read(3);
+  cnt->mmio   = perf_read(4);
+}
@@ -0,0 +1,71 @@
+#include <am.h>
+#include <virtio.h>
+
+// virtio console. Output is collected until a line is complete and then
+// sent with one descriptor. One receive buffer is kept posted, and its
+// content is handed out byte by byte. Without virtio, the serial port of
+// NEMU is used instead.
+
+#define VIRTIO_ID_CONSOLE 3
+#define BUF_SIZE 64
+
+#define UART_LSR_ADDR (SERIAL_PORT + 5)
+#define UART_LSR_DR   0x01
+
+enum { CONSOLE_RX, CONSOLE_TX };
+
+static VirtQueue rxq, txq;
+static bool present = false, use_virtio = false;
+static char txbuf[BUF_SIZE], rxbuf[BUF_SIZE], rxdata[BUF_SIZE];
+static int txlen = 0, rxlen = 0, rxpos = 0;
+
+static void post_rx() {
+  rxq.desc[0] = (struct virtq_desc) { (uintptr_t)rxbuf, BUF_SIZE, VIRTQ_DESC_F_WRITE, 0 };
+  virtq_submit(&rxq, 0);
+}
+
+static void tx_flush() {
+  if (txlen == 0) return;
+  txq.desc[0] = (struct virtq_desc) { (uintptr_t)txbuf, txlen, 0, 0 };
+  virtq_submit(&txq, 0);
+  while (!virtq_poll(&txq, NULL, NULL));
+  txlen = 0;
+}
+
+void __am_uart_init() {
+  if (!nemu_has(DEV_VIRTIO) || !virtio_init(VIRTIO_CONSOLE_ADDR, VIRTIO_ID_CONSOLE)) {
+    present = nemu_has(DEV_SERIAL);
+    return;
+  }
+  virtq_init(&rxq, VIRTIO_CONSOLE_ADDR, CONSOLE_RX);
+  virtq_init(&txq, VIRTIO_CONSOLE_ADDR, CONSOLE_TX);
+  virtio_ready(VIRTIO_CONSOLE_ADDR);
+  post_rx();
+  present = use_virtio = true;
+}
+
+void __am_uart_config(AM_UART_CONFIG_T *cfg) {
+  cfg->present = present;
+}
+
+void __am_uart_tx(AM_UART_TX_T *uart) {
+  if (!use_virtio) { outb(SERIAL_PORT, uart->data); return; }
+  txbuf[txlen ++] = uart->data;
+  if (uart->data == '\n' || txlen == BUF_SIZE) tx_flush();
+}
+
+void __am_uart_rx(AM_UART_RX_T *uart) {
+  if (!use_virtio) {
+    uart->data = (inb(UART_LSR_ADDR) & UART_LSR_DR) ? inb(SERIAL_PORT) : -1;
+    return;
+  }
+  tx_flush();
+  uint32_t len;
+  if (rxpos == rxlen && virtq_poll(&rxq, NULL, &len)) {
+    for (int i = 0; i < len; i ++) rxdata[i] = rxbuf[i];
+    rxlen = len;
+    rxpos = 0;
+    post_rx();
+  }
+  uart->data = (rxpos < rxlen ? rxdata[rxpos ++] : -1);
+}
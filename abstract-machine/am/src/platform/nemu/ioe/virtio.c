@@ -0,0 +1,76 @@
+#include <virtio.h>
+#include <klib.h>
+
+#define VIRTIO_MAGIC          0x000
+#define VIRTIO_DEVICE_ID      0x008
+#define VIRTIO_DEVICE_FEATURES 0x010
+#define VIRTIO_DEVICE_FEATURES_SEL 0x014
+#define VIRTIO_DRIVER_FEATURES 0x020
+#define VIRTIO_DRIVER_FEATURES_SEL 0x024
+#define VIRTIO_QUEUE_SEL      0x030
+#define VIRTIO_QUEUE_NUM      0x038
+#define VIRTIO_QUEUE_READY    0x044
+#define VIRTIO_QUEUE_NOTIFY   0x050
+#define VIRTIO_STATUS         0x070
+#define VIRTIO_QUEUE_DESC     0x080
+#define VIRTIO_QUEUE_AVAIL    0x090
+#define VIRTIO_QUEUE_USED     0x0a0
+
+#define VIRTIO_MAGIC_VALUE 0x74726976
+
+#define STATUS_ACK         1
+#define STATUS_DRIVER      2
+#define STATUS_DRIVER_OK   4
+#define STATUS_FEATURES_OK 8
+
+#define barrier() asm volatile("" : : : "memory")
+
+bool virtio_init(uintptr_t base, uint32_t device_id) {
+  if (inl(base + VIRTIO_MAGIC) != VIRTIO_MAGIC_VALUE ||
+      inl(base + VIRTIO_DEVICE_ID) != device_id) return false;
+  outl(base + VIRTIO_STATUS, 0);
+  outl(base + VIRTIO_STATUS, STATUS_ACK | STATUS_DRIVER);
+  // accept VIRTIO_F_VERSION_1 only
+  outl(base + VIRTIO_DEVICE_FEATURES_SEL, 1);
+  uint32_t features = inl(base + VIRTIO_DEVICE_FEATURES);
+  outl(base + VIRTIO_DRIVER_FEATURES_SEL, 1);
+  outl(base + VIRTIO_DRIVER_FEATURES, features & 1);
+  outl(base + VIRTIO_DRIVER_FEATURES_SEL, 0);
+  outl(base + VIRTIO_DRIVER_FEATURES, 0);
+  outl(base + VIRTIO_STATUS, STATUS_ACK | STATUS_DRIVER | STATUS_FEATURES_OK);
+  return true;
+}
+
+void virtio_ready(uintptr_t base) {
+  outl(base + VIRTIO_STATUS, STATUS_ACK | STATUS_DRIVER | STATUS_FEATURES_OK | STATUS_DRIVER_OK);
+}
+
+void virtq_init(VirtQueue *vq, uintptr_t base, int q) {
+  memset(vq, 0, sizeof(*vq));
+  vq->base = base;
+  vq->q = q;
+  outl(base + VIRTIO_QUEUE_SEL, q);
+  outl(base + VIRTIO_QUEUE_NUM, VIRTQ_NUM);
+  outl(base + VIRTIO_QUEUE_DESC, (uintptr_t)vq->desc);
+  outl(base + VIRTIO_QUEUE_AVAIL, (uintptr_t)&vq->avail);
+  outl(base + VIRTIO_QUEUE_USED, (uintptr_t)&vq->used);
+  outl(base + VIRTIO_QUEUE_READY, 1);
+}
+
+void virtq_submit(VirtQueue *vq, int head) {
+  vq->avail.ring[vq->avail.idx % VIRTQ_NUM] = head;
+  barrier();
+  vq->avail.idx ++;
+  barrier();
+  outl(vq->base + VIRTIO_QUEUE_NOTIFY, vq->q);
+}
+
+bool virtq_poll(VirtQueue *vq, uint32_t *id, uint32_t *len) {
+  barrier();
+  if (*(volatile uint16_t *)&vq->used.idx == vq->last_used) return false;
+  int i = vq->last_used % VIRTQ_NUM;
+  if (id) *id = vq->used.ring[i].id;
+  if (len) *len = vq->used.ring[i].len;
+  vq->last_used ++;
+  return true;
+}
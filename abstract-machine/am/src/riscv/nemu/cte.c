@@ -2,12 +2,24 @@
 #include <riscv/riscv.h>
 #include <klib.h>
 
+#define MCAUSE_ECALL_M 11
+#define MCAUSE_IRQ_TIMER ((uintptr_t)1 << (__riscv_xlen - 1) | 7)
+#define MSTATUS_MIE  (1 << 3)
+#define MSTATUS_MPIE (1 << 7)
+#define MSTATUS_MPP  (3 << 11)
+#define MIE_MTIE     (1 << 7)
+
 static Context* (*user_handler)(Event, Context*) = NULL;
 
 Context* __am_irq_handle(Context *c) {
   if (user_handler) {
     Event ev = {0};
     switch (c->mcause) {
+      case MCAUSE_ECALL_M:
+        ev.event = (c->GPR1 == (uintptr_t)-1 ? EVENT_YIELD : EVENT_SYSCALL);
+        c->mepc += 4;
+        break;
+      case MCAUSE_IRQ_TIMER: ev.event = EVENT_IRQ_TIMER; break;
       default: ev.event = EVENT_ERROR; break;
     }
 
@@ -23,6 +35,7 @@ extern void __am_asm_trap(void);
 bool cte_init(Context*(*handler)(Event, Context*)) {
   // initialize exception entry
   asm volatile("csrw mtvec, %0" : : "r"(__am_asm_trap));
+  asm volatile("csrs mie, %0" : : "r"(MIE_MTIE));
 
   // register event handler
   user_handler = handler;
@@ -31,7 +44,12 @@ bool cte_init(Context*(*handler)(Event, Context*)) {
 }
 
 Context *kcontext(Area kstack, void (*entry)(void *), void *arg) {
-  return NULL;
+  Context *c = (Context *)kstack.end - 1;
+  memset(c, 0, sizeof(*c));
+  c->mepc = (uintptr_t)entry;
+  c->mstatus = MSTATUS_MPP | MSTATUS_MPIE;
+  c->GPR2 = (uintptr_t)arg;
+  return c;
 }
 
 void yield() {
@@ -43,8 +61,12 @@ void yield() {
 }
 
 bool ienabled() {
-  return false;
+  uintptr_t mstatus;
+  asm volatile("csrr %0, mstatus" : "=r"(mstatus));
+  return (mstatus & MSTATUS_MIE) != 0;
 }
 
 void iset(bool enable) {
+  if (enable) asm volatile("csrs mstatus, %0" : : "r"(MSTATUS_MIE));
+  else asm volatile("csrc mstatus, %0" : : "r"(MSTATUS_MIE));
 }
@@ -304,6 +304,8 @@ static void disk_blkio(AM_DISK_BLKIO_T *bio) {
 
 static void audio_config(AM_AUDIO_CONFIG_T *cfg) { cfg->present = false; }
 static void net_config(AM_NET_CONFIG_T *cfg) { cfg->present = false; }
+static void dma_config(AM_DMA_CONFIG_T *cfg) { cfg->present = false; }
+static void perf_config(AM_PERF_CONFIG_T *cfg) { cfg->present = false; }
 static void fail(void *buf) { panic("access nonexist register"); }
 
 typedef void (*handler_t)(void *buf);
@@ -326,6 +328,8 @@ static void *lut[128] = {
   [AM_DISK_STATUS ] = disk_status,
   [AM_DISK_BLKIO  ] = disk_blkio,
   [AM_NET_CONFIG  ] = net_config,
+  [AM_DMA_CONFIG  ] = dma_config,
+  [AM_PERF_CONFIG ] = perf_config,
 };
 
 
@@ -5,6 +5,11 @@ AM_SRCS := platform/nemu/trm.c \
            platform/nemu/ioe/gpu.c \
            platform/nemu/ioe/audio.c \
            platform/nemu/ioe/disk.c \
+           platform/nemu/ioe/uart.c \
+           platform/nemu/ioe/dma.c \
+           platform/nemu/ioe/net.c \
+           platform/nemu/ioe/perf.c \
+           platform/nemu/ioe/virtio.c \
            platform/nemu/mpe.c
 
 CFLAGS    += -fdata-sections -ffunction-sections
@@ -0,0 +1,35 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_BPRED_H__
+#define __CPU_BPRED_H__
+
+#include <common.h>
+
+// kinds of unconditional jumps, as flags
+#define BP_INDIRECT 0x1 // the target comes from a register
+#define BP_CALL     0x2 // the return address is linked
+#define BP_RET      0x4
+
+#ifdef CONFIG_BPRED
+void bpred_branch(vaddr_t pc, bool taken, vaddr_t target);
+void bpred_jump(vaddr_t pc, vaddr_t target, int kind);
+void init_bpred();
+#else
+#define bpred_branch(pc, taken, target)
+#define bpred_jump(pc, target, kind)
+#endif
+
+#endif
@@ -0,0 +1,60 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_ITRACE_H__
+#define __CPU_ITRACE_H__
+
+#include <stdint.h>
+
+// Format of the binary traces, shared with tools/nemu-trace.
+//
+// A trace file starts with a TraceHeader, followed by `nr_rec` records of
+// `rec_size` bytes each, in execution order. All fields are little-endian
+// and not padded. `nr_rec` is updated with every record, so a trace cut
+// short by a crash is still readable.
+//
+// The instruction trace (magic ITRACE_MAGIC) has records of
+//
+//   pc (xlen bytes), instruction (4 bytes), [rd value (xlen bytes)]
+//
+// The rd value is the content of the destination register field after
+// the instruction is executed; it is present when `has_value` is set.
+//
+// The memory trace (magic MTRACE_MAGIC) has records of
+//
+//   pc (xlen bytes), address (xlen bytes), kind (1 byte), length (1 byte),
+//   [data (xlen bytes)]
+//
+// where the kind is one of MTRACE_READ/WRITE/FETCH, and the data read or
+// written is present when `has_value` is set.
+
+#define ITRACE_MAGIC "NEMUITRC"
+#define MTRACE_MAGIC "NEMUMTRC"
+
+#define MTRACE_READ  0x1
+#define MTRACE_WRITE 0x2
+#define MTRACE_FETCH 0x4
+
+typedef struct {
+  char magic[8];
+  char isa[16];       // the guest ISA as in $(GUEST_ISA), e.g. "riscv32"
+  uint32_t xlen;      // size of the pc, addresses and values in bytes
+  uint32_t has_value;
+  uint32_t rec_size;
+  uint32_t reserved;
+  uint64_t nr_rec;
+} TraceHeader;
+
+#endif
@@ -0,0 +1,35 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_PERF_H__
+#define __CPU_PERF_H__
+
+#include <common.h>
+
+// Event counters visible to the guest through the perf device and the
+// hpm CSRs. Retired instructions are counted by `g_nr_guest_inst`.
+typedef struct {
+  uint64_t load;
+  uint64_t store;
+  uint64_t branch;  // taken conditional branches
+  uint64_t mmio;
+} PerfCounter;
+
+extern uint64_t g_nr_guest_inst;
+extern PerfCounter g_perf;
+
+#define perf_count(event) IFDEF(CONFIG_HAS_PERF, g_perf.event ++)
+
+#endif
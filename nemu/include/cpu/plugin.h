@@ -0,0 +1,39 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_PLUGIN_H__
+#define __CPU_PLUGIN_H__
+
+#include <common.h>
+#include <cpu/decode.h>
+#include <nemu-plugin.h>
+
+// the event classes with registered callbacks
+#define PLUGIN_INST  0x01
+#define PLUGIN_MEM   0x02
+#define PLUGIN_BLOCK 0x04
+#define PLUGIN_TRAP  0x08
+
+extern uint32_t g_plugin_mask;
+
+#define plugin_on(event) unlikely(g_plugin_mask & (event))
+
+void plugin_inst(Decode *s);
+void plugin_block(vaddr_t pc);
+void plugin_mem(int kind, vaddr_t addr, int len, word_t data);
+void plugin_trap(vaddr_t pc, word_t cause, vaddr_t handler);
+void load_plugin(const char *spec);
+
+#endif
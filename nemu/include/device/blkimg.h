@@ -0,0 +1,33 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __DEVICE_BLKIMG_H__
+#define __DEVICE_BLKIMG_H__
+
+#include <common.h>
+
+// A disk image backing a block device. In overlay mode the image itself
+// is opened read-only, and written blocks go to a per-run delta.
+
+typedef struct BlkImg BlkImg;
+
+BlkImg *blkimg_open(const char *path, bool overlay);
+uint64_t blkimg_size(BlkImg *img);
+void blkimg_read(BlkImg *img, uint64_t off, void *buf, uint64_t len);
+void blkimg_write(BlkImg *img, uint64_t off, const void *buf, uint64_t len);
+void blkimg_prefetch(BlkImg *img, uint64_t off, uint64_t len);
+
+#endif
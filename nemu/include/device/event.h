@@ -0,0 +1,41 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __DEVICE_EVENT_H__
+#define __DEVICE_EVENT_H__
+
+#include <common.h>
+
+// Device events are scheduled on the count of retired guest instructions.
+// The CPU only compares `g_nr_guest_inst` with `g_next_event`, which is
+// accessed atomically as the alarm thread writes it, and calls
+// event_run() once the earliest deadline is reached.
+// With CONFIG_ICOUNT, the guest time is also derived from this count, so
+// runs are reproducible. Other threads may call event_kick() to get
+// event_run() called after the current instruction.
+
+typedef void (*event_handler_t)();
+
+extern uint64_t g_next_event;
+
+void event_add(const char *name, uint64_t period_us, event_handler_t handler);
+void event_run();
+void event_kick();
+uint64_t event_us_to_inst(uint64_t us);
+uint64_t event_time_us();
+void event_idle();
+
+#endif
@@ -0,0 +1,53 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __DEVICE_VGACAP_H__
+#define __DEVICE_VGACAP_H__
+
+#include <stdint.h>
+
+// Format of the headless VGA capture stream, shared with tools/vga-capture.
+//
+// The stream starts with a VGACapHeader, followed by one record for each
+// screen update whose content differs from the previous one:
+//
+//   VGACapFrame { tick, nr_span }
+//   nr_span * (VGACapSpan { first_row, nr_row } + nr_row * width pixels)
+//
+// Only the rows changed since the last record are stored. `tick` counts
+// the screen refresh periods (1 / hz second) since the capture begins,
+// so skipped frames can be restored by repeating the previous record.
+// Pixels are in the ARGB8888 format of the frame buffer.
+
+#define VGACAP_MAGIC "NEMUVCAP"
+
+typedef struct {
+  char magic[8];
+  uint32_t width, height;
+  uint32_t hz;
+} VGACapHeader;
+
+typedef struct {
+  uint32_t tick;
+  uint32_t nr_span;
+} VGACapFrame;
+
+typedef struct {
+  uint32_t first_row;
+  uint32_t nr_row;
+} VGACapSpan;
+
+#endif
@@ -0,0 +1,71 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __DEVICE_VIRTIO_H__
+#define __DEVICE_VIRTIO_H__
+
+#include <device/map.h>
+
+// A subset of the virtio-mmio transport (version 2) with split
+// virtqueues. There is no interrupt controller in NEMU, so drivers poll
+// the used rings instead of waiting for an interrupt.
+
+#define VIRTIO_MMIO_SIZE 0x200
+#define VIRTIO_MAX_QUEUE 2
+#define VIRTQ_NUM_MAX 64
+
+enum { VIRTIO_ID_BLOCK = 2, VIRTIO_ID_CONSOLE = 3 };
+
+#define VIRTQ_DESC_F_NEXT  1
+#define VIRTQ_DESC_F_WRITE 2
+
+typedef struct {
+  uint64_t addr;
+  uint32_t len;
+  uint16_t flags;
+  uint16_t next;
+} VirtqDesc;
+
+typedef struct {
+  uint32_t num;
+  bool ready;
+  paddr_t desc, avail, used;
+  uint16_t last_avail;
+} Virtq;
+
+typedef struct VirtioDev VirtioDev;
+typedef void (*virtio_notify_t)(VirtioDev *dev, int q);
+
+struct VirtioDev {
+  uint32_t *regs;
+  uint32_t device_id;
+  int nr_queue;
+  Virtq vq[VIRTIO_MAX_QUEUE];
+  virtio_notify_t notify;
+};
+
+void virtio_init(VirtioDev *dev, const char *name, paddr_t addr,
+    uint32_t device_id, int nr_queue, io_callback_t handler, virtio_notify_t notify);
+void virtio_mmio_access(VirtioDev *dev, uint32_t offset, int len, bool is_write);
+void *virtio_config(VirtioDev *dev);
+
+bool virtq_has_avail(VirtioDev *dev, int q);
+VirtqDesc *virtq_pop(VirtioDev *dev, int q, int *head);
+VirtqDesc *virtq_next(VirtioDev *dev, int q, VirtqDesc *d);
+void *virtq_buf(VirtqDesc *d);
+void virtq_push(VirtioDev *dev, int q, int head, uint32_t len);
+
+#endif
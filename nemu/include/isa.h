@@ -36,6 +36,9 @@ word_t isa_reg_str2val(const char *name, bool *success);
 // exec
 struct Decode;
 int isa_exec_once(struct Decode *s);
+#ifndef isa_inst_rd_val
+#define isa_inst_rd_val(s) 0
+#endif
 
 // memory
 enum { MMU_DIRECT, MMU_TRANSLATE, MMU_FAIL };
@@ -50,6 +53,10 @@ paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type);
 vaddr_t isa_raise_intr(word_t NO, vaddr_t epc);
 #define INTR_EMPTY ((word_t)-1)
 word_t isa_query_intr();
+void isa_dev_intr();
+#ifndef isa_has_intr
+#define isa_has_intr() true
+#endif
 
 // difftest
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc);
@@ -0,0 +1,31 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __MEMORY_CACHESIM_H__
+#define __MEMORY_CACHESIM_H__
+
+#include <common.h>
+
+enum { CACHE_FETCH, CACHE_READ, CACHE_WRITE };
+
+#ifdef CONFIG_CACHESIM
+void cachesim_access(int type, vaddr_t addr, int len);
+void init_cachesim();
+#define cachesim(type, addr, len) cachesim_access(type, addr, len)
+#else
+#define cachesim(type, addr, len)
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __NEMU_PLUGIN_H__
+#define __NEMU_PLUGIN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// The interface between NEMU and instrumentation plugins.
+//
+// A plugin is a shared library loaded with `--plugin=lib.so[,args]`. It
+// exports `nemu_plugin_version`, which must equal NEMU_PLUGIN_VERSION, and
+// `nemu_plugin_install()`, which is called once with the API below and
+// the text after the first comma. The plugin registers callbacks for the
+// event classes it needs; an event class without callbacks costs nothing
+// beyond one branch in NEMU.
+//
+// Callbacks run on the CPU thread, in the order they are registered.
+// Addresses and values are widened to 64 bits.
+
+#define NEMU_PLUGIN_VERSION 1
+
+#define NEMU_PLUGIN_EXPORT __attribute__((visibility("default")))
+
+// kinds of memory accesses
+#define NEMU_MEM_READ  0x1
+#define NEMU_MEM_WRITE 0x2
+#define NEMU_MEM_FETCH 0x4
+
+// an instruction has been executed, `inst' points to its `len' bytes
+typedef void (*nemu_inst_cb_t)(void *udata, uint64_t pc, const uint8_t *inst, int len);
+// a memory access by the instruction at `pc'; `data' is the value read or written
+typedef void (*nemu_mem_cb_t)(void *udata, uint64_t pc, uint64_t addr, int len, int kind, uint64_t data);
+// a basic block starting at `pc' is about to be executed, that is, the
+// control flow did not fall through to `pc'
+typedef void (*nemu_block_cb_t)(void *udata, uint64_t pc);
+// an exception, system call or interrupt with the ISA's cause number is
+// taken at `pc', and the execution continues at `handler'
+typedef void (*nemu_trap_cb_t)(void *udata, uint64_t pc, uint64_t cause, uint64_t handler);
+// NEMU exits; `state' is the one of nemu_state, `halt_ret' the guest exit code
+typedef void (*nemu_exit_cb_t)(void *udata, int state, uint32_t halt_ret, uint64_t nr_inst);
+
+typedef struct {
+  uint32_t version;
+  const char *isa;  // e.g. "riscv32"
+
+  // register a callback, `udata' is passed back to it
+  void (*register_inst)(nemu_inst_cb_t cb, void *udata);
+  void (*register_mem)(nemu_mem_cb_t cb, void *udata);
+  void (*register_block)(nemu_block_cb_t cb, void *udata);
+  void (*register_trap)(nemu_trap_cb_t cb, void *udata);
+  void (*register_exit)(nemu_exit_cb_t cb, void *udata);
+
+  // read a register by its name as in the debugger, e.g. "a0" or "pc"
+  uint64_t (*read_reg)(const char *name, bool *success);
+  // copy guest physical memory, false if it is not all in the memory
+  bool (*read_mem)(uint64_t paddr, void *buf, size_t len);
+  // the number of instructions executed so far
+  uint64_t (*nr_inst)();
+} NemuPluginAPI;
+
+NEMU_PLUGIN_EXPORT extern const uint32_t nemu_plugin_version;
+// return 0 on success, NEMU exits otherwise
+NEMU_PLUGIN_EXPORT int nemu_plugin_install(const NemuPluginAPI *api, const char *args);
+
+#endif
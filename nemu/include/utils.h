@@ -17,6 +17,7 @@
 #define __UTILS_H__
 
 #include <common.h>
+#include <cpu/itrace.h>
 
 // ----------- state -----------
 
@@ -58,12 +59,9 @@ uint64_t get_time();
 
 #define log_write(...) IFDEF(CONFIG_TARGET_NATIVE_ELF, \
   do { \
-    extern FILE* log_fp; \
     extern bool log_enable(); \
-    if (log_enable()) { \
-      fprintf(log_fp, __VA_ARGS__); \
-      fflush(log_fp); \
-    } \
+    extern void log_printf(const char *fmt, ...); \
+    if (log_enable()) log_printf(__VA_ARGS__); \
   } while (0) \
 )
 
@@ -74,16 +72,54 @@ uint64_t get_time();
   } while (0)
 
 
-#endif
 
 // ------------------iringtrace ----------------------------
 void trace_inst(word_t pc,uint32_t inst);
 void display_inst();
 
+// -----------------------binary traces --------------------------
+// a trace file in the format of <cpu/itrace.h>, mapped into memory
+typedef struct {
+  int fd;
+  uint8_t *buf;
+  size_t len, cap;
+} TraceFile;
+
+void trace_file_open(TraceFile *f, const char *path, const char *magic,
+    uint32_t has_value, uint32_t rec_size);
+void trace_file_grow(TraceFile *f);
+
+// return the room for a new record
+static inline void *trace_file_append(TraceFile *f, size_t size) {
+  if (unlikely(f->len + size > f->cap)) trace_file_grow(f);
+  void *p = f->buf + f->len;
+  f->len += size;
+  ((TraceHeader *)f->buf)->nr_rec ++;
+  return p;
+}
+
 // -----------------------mtrace --------------------------
-void display_mem_addr(word_t addr,int len);
+// the kinds of accesses being traced, 0 when mtrace is off
+extern uint32_t g_mtrace_kind;
+void mtrace_record(int kind, vaddr_t addr, int len, word_t data);
+bool mtrace_config(const char *spec);
+void init_mtrace(const char *spec);
 
 // -----------------------ftrace --------------------------
 void trace_func_call(paddr_t pc ,paddr_t target, bool is_tail);
 
-void trace_func_ret(paddr_t pc);
\ No newline at end of file
+void trace_func_ret(paddr_t pc);
+
+// symbol index of the function containing pc, -1 if there is none
+int ftrace_find_func(paddr_t pc);
+const char *ftrace_func_name(int i);
+int ftrace_nr_func();
+// the symbol indices of the active functions, outermost first
+int ftrace_call_stack(const int **frames);
+
+// -----------------------profiler --------------------------
+extern uint64_t g_prof_next;
+void profile_sample(vaddr_t pc);
+void init_profiler();
+
+#endif
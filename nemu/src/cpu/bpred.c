@@ -0,0 +1,407 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <cpu/bpred.h>
+#include <cpu/perf.h>
+#include <utils.h>
+
+// Branch predictor models are fed with every conditional branch and run
+// side by side, so one run compares all of them. Each model is a pair
+// of predict() and update() calls around the actual outcome; the global
+// history is shifted after all models are updated.
+//
+// Targets of indirect jumps are predicted by a direct-mapped BTB, and
+// returns by a return address stack. Direct jumps are assumed to be
+// resolved at decode and never mispredicted.
+
+#define TABLE_BITS CONFIG_BPRED_TABLE_BITS
+#define TABLE_SIZE (1u << TABLE_BITS)
+#define BTB_SIZE (1u << CONFIG_BPRED_BTB_BITS)
+#define RAS_SIZE CONFIG_BPRED_RAS_SIZE
+
+#define MAX_MODEL 3
+#define NR_TARGET 4
+
+static uint64_t ghist = 0; // outcomes of conditional branches, the newest in bit 0
+
+static inline uint32_t pc_idx(vaddr_t pc) { return pc >> 2; }
+
+// fold the newest `len' bits of the history into `bits' bits
+static inline uint32_t fold(uint64_t h, int len, int bits) {
+  if (len < 64) h &= (1ull << len) - 1;
+  uint32_t f = 0;
+  for (; h != 0; h >>= bits) f ^= h & ((1u << bits) - 1);
+  return f;
+}
+
+// 2-bit saturating counters, taken when >= 2
+static inline void ctr_update(uint8_t *c, bool taken) {
+  if (taken) { if (*c < 3) (*c) ++; }
+  else if (*c > 0) (*c) --;
+}
+
+// ----------------------- bimodal -----------------------
+
+#ifdef CONFIG_BPRED_BIMODAL
+static uint8_t *bimodal = NULL;
+
+static bool bimodal_predict(vaddr_t pc) {
+  return bimodal[pc_idx(pc) & (TABLE_SIZE - 1)] >= 2;
+}
+
+static void bimodal_update(vaddr_t pc, bool taken) {
+  ctr_update(&bimodal[pc_idx(pc) & (TABLE_SIZE - 1)], taken);
+}
+#endif
+
+// ----------------------- gshare -----------------------
+
+#ifdef CONFIG_BPRED_GSHARE
+static uint8_t *gshare = NULL;
+
+static uint32_t gshare_idx(vaddr_t pc) {
+  return (pc_idx(pc) ^ fold(ghist, CONFIG_BPRED_HIST_LEN, TABLE_BITS)) & (TABLE_SIZE - 1);
+}
+
+static bool gshare_predict(vaddr_t pc) {
+  return gshare[gshare_idx(pc)] >= 2;
+}
+
+static void gshare_update(vaddr_t pc, bool taken) {
+  ctr_update(&gshare[gshare_idx(pc)], taken);
+}
+#endif
+
+// ----------------------- TAGE-lite -----------------------
+// A bimodal base predictor and four tagged tables indexed with
+// geometrically longer histories. The longest matching table provides
+// the prediction. A misprediction allocates an entry in a longer table.
+
+#ifdef CONFIG_BPRED_TAGE
+#define TAGE_NR_TABLE 4
+#define TAGE_BITS (TABLE_BITS - 2)
+#define TAGE_SIZE (1u << TAGE_BITS)
+#define TAGE_TAG_BITS 9
+#define TAGE_AGE_PERIOD (1u << 18) // branches between halving the useful bits
+
+typedef struct {
+  uint16_t tag;
+  int8_t ctr;  // 3-bit signed, taken when >= 0
+  uint8_t u;   // 2-bit useful counter
+} TageEntry;
+
+static const int tage_hist_len[TAGE_NR_TABLE] = { 4, 10, 24, 60 };
+static uint8_t *tage_base = NULL;
+static TageEntry *tage[TAGE_NR_TABLE] = {};
+static uint32_t tage_tick = 0;
+
+// the lookup of the branch being predicted, used again by the update
+static struct {
+  uint32_t base_idx;
+  uint32_t idx[TAGE_NR_TABLE];
+  uint16_t tag[TAGE_NR_TABLE];
+  int provider, alt; // table index, -1 for the base predictor
+  bool pred, alt_pred;
+} tl;
+
+static bool tage_predict(vaddr_t pc) {
+  uint32_t p = pc_idx(pc);
+  tl.base_idx = p & (TABLE_SIZE - 1);
+  tl.provider = tl.alt = -1;
+  for (int i = 0; i < TAGE_NR_TABLE; i ++) {
+    int len = tage_hist_len[i];
+    tl.idx[i] = (p ^ (p >> TAGE_BITS) ^ fold(ghist, len, TAGE_BITS)) & (TAGE_SIZE - 1);
+    tl.tag[i] = (p ^ fold(ghist, len, TAGE_TAG_BITS) ^ (fold(ghist, len, TAGE_TAG_BITS - 1) << 1))
+      & ((1u << TAGE_TAG_BITS) - 1);
+    if (tage[i][tl.idx[i]].tag == tl.tag[i]) { tl.alt = tl.provider; tl.provider = i; }
+  }
+  bool base = tage_base[tl.base_idx] >= 2;
+  tl.pred = (tl.provider >= 0 ? tage[tl.provider][tl.idx[tl.provider]].ctr >= 0 : base);
+  tl.alt_pred = (tl.alt >= 0 ? tage[tl.alt][tl.idx[tl.alt]].ctr >= 0 : base);
+  return tl.pred;
+}
+
+static void tage_update(vaddr_t pc, bool taken) {
+  if (tl.provider >= 0) {
+    TageEntry *e = &tage[tl.provider][tl.idx[tl.provider]];
+    if (tl.pred != tl.alt_pred) {
+      if (tl.pred == taken) { if (e->u < 3) e->u ++; }
+      else if (e->u > 0) e->u --;
+    }
+    if (taken) { if (e->ctr < 3) e->ctr ++; }
+    else if (e->ctr > -4) e->ctr --;
+  } else ctr_update(&tage_base[tl.base_idx], taken);
+
+  if (tl.pred != taken) {
+    bool allocated = false;
+    for (int i = tl.provider + 1; i < TAGE_NR_TABLE && !allocated; i ++) {
+      TageEntry *e = &tage[i][tl.idx[i]];
+      if (e->u == 0) {
+        *e = (TageEntry) { .tag = tl.tag[i], .ctr = (taken ? 0 : -1), .u = 0 };
+        allocated = true;
+      }
+    }
+    if (!allocated) {
+      for (int i = tl.provider + 1; i < TAGE_NR_TABLE; i ++) {
+        if (tage[i][tl.idx[i]].u > 0) tage[i][tl.idx[i]].u --;
+      }
+    }
+  }
+
+  if (++ tage_tick == TAGE_AGE_PERIOD) {
+    tage_tick = 0;
+    for (int i = 0; i < TAGE_NR_TABLE; i ++) {
+      for (uint32_t j = 0; j < TAGE_SIZE; j ++) tage[i][j].u >>= 1;
+    }
+  }
+}
+#endif
+
+// ----------------------- models -----------------------
+
+typedef struct {
+  const char *name;
+  bool (*predict)(vaddr_t pc);
+  void (*update)(vaddr_t pc, bool taken);
+} BPredModel;
+
+static const BPredModel model[] = {
+#ifdef CONFIG_BPRED_BIMODAL
+  { "bimodal", bimodal_predict, bimodal_update },
+#endif
+#ifdef CONFIG_BPRED_GSHARE
+  { "gshare", gshare_predict, gshare_update },
+#endif
+#ifdef CONFIG_BPRED_TAGE
+  { "TAGE-lite", tage_predict, tage_update },
+#endif
+};
+
+#define NR_MODEL ARRLEN(model)
+
+static uint64_t model_miss[MAX_MODEL] = {};
+
+// ----------------------- BTB and RAS -----------------------
+
+typedef struct {
+  vaddr_t pc, target;
+} BTBEntry;
+
+static BTBEntry btb[BTB_SIZE] = {};
+static vaddr_t ras[RAS_SIZE] = {};
+static int ras_top = 0, ras_n = 0; // the oldest entry is overwritten on overflow
+
+static uint64_t nr_cond = 0, nr_taken = 0, nr_jump = 0;
+static uint64_t nr_indirect = 0, btb_miss = 0, nr_ret = 0, ras_miss = 0;
+
+// ----------------------- per-pc statistics -----------------------
+
+typedef struct {
+  vaddr_t pc;
+  int kind; // -1 for a conditional branch, or the BP_* flags of a jump
+  uint64_t exec, taken;
+  uint64_t miss[MAX_MODEL]; // per model, or of the target for a jump
+  vaddr_t target[NR_TARGET];
+  uint64_t nr_target[NR_TARGET], nr_other_target;
+} BranchStat;
+
+static BranchStat *br_stat = NULL; // open addressing, pc 0 marks an empty slot
+static uint32_t br_stat_size = 0, nr_br_stat = 0;
+
+static uint32_t br_stat_hash(vaddr_t pc) {
+  return (pc_idx(pc) * 0x9e3779b1u) & (br_stat_size - 1);
+}
+
+static BranchStat *br_stat_get(vaddr_t pc, int kind) {
+  if (nr_br_stat * 2 >= br_stat_size) {
+    BranchStat *old = br_stat;
+    uint32_t old_size = br_stat_size;
+    br_stat_size = (old_size == 0 ? 1024 : old_size * 2);
+    br_stat = calloc(br_stat_size, sizeof(BranchStat));
+    assert(br_stat);
+    for (uint32_t i = 0; i < old_size; i ++) {
+      if (old[i].pc == 0) continue;
+      uint32_t h = br_stat_hash(old[i].pc);
+      while (br_stat[h].pc != 0) h = (h + 1) & (br_stat_size - 1);
+      br_stat[h] = old[i];
+    }
+    free(old);
+  }
+  uint32_t h = br_stat_hash(pc);
+  for (; br_stat[h].pc != 0; h = (h + 1) & (br_stat_size - 1)) {
+    if (br_stat[h].pc == pc) return &br_stat[h];
+  }
+  br_stat[h].pc = pc;
+  br_stat[h].kind = kind;
+  nr_br_stat ++;
+  return &br_stat[h];
+}
+
+static void count_target(BranchStat *s, vaddr_t target) {
+  for (int i = 0; i < NR_TARGET; i ++) {
+    if (s->nr_target[i] == 0) s->target[i] = target;
+    if (s->target[i] == target) { s->nr_target[i] ++; return; }
+  }
+  s->nr_other_target ++;
+}
+
+// ----------------------- hooks -----------------------
+
+void bpred_branch(vaddr_t pc, bool taken, vaddr_t target) {
+  BranchStat *s = br_stat_get(pc, -1);
+  s->exec ++;
+  s->taken += taken;
+  nr_cond ++;
+  nr_taken += taken;
+  for (int i = 0; i < NR_MODEL; i ++) {
+    if (model[i].predict(pc) != taken) { model_miss[i] ++; s->miss[i] ++; }
+    model[i].update(pc, taken);
+  }
+  ghist = (ghist << 1) | taken;
+}
+
+void bpred_jump(vaddr_t pc, vaddr_t target, int kind) {
+  BranchStat *s = br_stat_get(pc, kind);
+  s->exec ++;
+  s->taken ++;
+  nr_jump ++;
+  bool miss = false;
+  if (kind & BP_RET) {
+    nr_ret ++;
+    if (ras_n == 0) miss = true;
+    else {
+      ras_top = (ras_top + RAS_SIZE - 1) % RAS_SIZE;
+      ras_n --;
+      miss = (ras[ras_top] != target);
+    }
+    ras_miss += miss;
+  } else if (kind & BP_INDIRECT) {
+    nr_indirect ++;
+    BTBEntry *e = &btb[pc_idx(pc) & (BTB_SIZE - 1)];
+    miss = (e->pc != pc || e->target != target);
+    *e = (BTBEntry) { .pc = pc, .target = target };
+    btb_miss += miss;
+  }
+  if (kind & BP_CALL) {
+    ras[ras_top] = pc + 4;
+    ras_top = (ras_top + 1) % RAS_SIZE;
+    if (ras_n < RAS_SIZE) ras_n ++;
+  }
+  s->miss[0] += miss;
+  if (kind & (BP_INDIRECT | BP_RET)) count_target(s, target);
+}
+
+// ----------------------- report -----------------------
+
+static double mpki(uint64_t miss) {
+  return g_nr_guest_inst ? 1000.0 * miss / g_nr_guest_inst : 0;
+}
+
+static uint64_t br_stat_miss(const BranchStat *s) {
+  uint64_t m = 0;
+  for (int i = 0; i < MAX_MODEL; i ++) m += s->miss[i];
+  return m;
+}
+
+static int br_stat_cmp(const void *a, const void *b) {
+  const BranchStat *x = a, *y = b;
+  uint64_t mx = br_stat_miss(x), my = br_stat_miss(y);
+  if (mx != my) return mx < my ? 1 : -1;
+  return x->exec < y->exec ? 1 : (x->exec > y->exec ? -1 : 0);
+}
+
+static const char *kind_name(int kind) {
+  if (kind < 0) return "branch";
+  if (kind & BP_RET) return "ret";
+  if (kind & BP_CALL) return (kind & BP_INDIRECT ? "icall" : "call");
+  return (kind & BP_INDIRECT ? "ijump" : "jump");
+}
+
+static void write_report() {
+  const char *path = CONFIG_BPRED_REPORT_PATH;
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) { perror(path); return; }
+
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < br_stat_size; i ++) {
+    if (br_stat[i].pc != 0) br_stat[n ++] = br_stat[i];
+  }
+  qsort(br_stat, n, sizeof(BranchStat), br_stat_cmp);
+
+  // for a jump, the first column is the target mispredicts of the BTB or the RAS
+  fprintf(fp, "%-10s %-6s %12s %7s", "pc", "kind", "executed", "taken%");
+  for (int i = 0; i < NR_MODEL; i ++) fprintf(fp, " %12s", model[i].name);
+  fprintf(fp, "  function\n");
+  for (uint32_t i = 0; i < n; i ++) {
+    BranchStat *s = &br_stat[i];
+    fprintf(fp, FMT_WORD " %-6s %12" PRIu64 " %6.2f%%", s->pc, kind_name(s->kind),
+        s->exec, 100.0 * s->taken / s->exec);
+    for (int j = 0; j < NR_MODEL; j ++) {
+      if (s->kind < 0 || j == 0) fprintf(fp, " %12" PRIu64, s->miss[j]);
+      else fprintf(fp, " %12s", "");
+    }
+    fprintf(fp, "  %s\n", ftrace_func_name(ftrace_find_func(s->pc)));
+    for (int j = 0; j < NR_TARGET && s->nr_target[j] > 0; j ++) {
+      fprintf(fp, "  -> " FMT_WORD " %12" PRIu64 "  %s\n", s->target[j], s->nr_target[j],
+          ftrace_func_name(ftrace_find_func(s->target[j])));
+    }
+    if (s->nr_other_target > 0) {
+      fprintf(fp, "  -> %-10s %12" PRIu64 "\n", "others", s->nr_other_target);
+    }
+  }
+  fclose(fp);
+  Log("Per-branch statistics are written to %s", path);
+}
+
+static void bpred_report() {
+  Log("branches: %" PRIu64 " conditional (%.2f%% taken), %" PRIu64 " jumps",
+      nr_cond, nr_cond ? 100.0 * nr_taken / nr_cond : 0, nr_jump);
+  for (int i = 0; i < NR_MODEL; i ++) {
+    Log("%-9s: %" PRIu64 " mispredicts (%.2f%%), MPKI = %.3f, with BTB and RAS = %.3f",
+        model[i].name, model_miss[i], nr_cond ? 100.0 * model_miss[i] / nr_cond : 0,
+        mpki(model_miss[i]), mpki(model_miss[i] + btb_miss + ras_miss));
+  }
+  Log("BTB      : %" PRIu64 " of %" PRIu64 " indirect jumps mispredicted, MPKI = %.3f",
+      btb_miss, nr_indirect, mpki(btb_miss));
+  Log("RAS      : %" PRIu64 " of %" PRIu64 " returns mispredicted, MPKI = %.3f",
+      ras_miss, nr_ret, mpki(ras_miss));
+  write_report();
+}
+
+void init_bpred() {
+  // counters start weakly taken
+#ifdef CONFIG_BPRED_BIMODAL
+  bimodal = malloc(TABLE_SIZE);
+  assert(bimodal);
+  memset(bimodal, 2, TABLE_SIZE);
+#endif
+#ifdef CONFIG_BPRED_GSHARE
+  gshare = malloc(TABLE_SIZE);
+  assert(gshare);
+  memset(gshare, 2, TABLE_SIZE);
+#endif
+#ifdef CONFIG_BPRED_TAGE
+  tage_base = malloc(TABLE_SIZE);
+  assert(tage_base);
+  memset(tage_base, 2, TABLE_SIZE);
+  for (int i = 0; i < TAGE_NR_TABLE; i ++) {
+    tage[i] = calloc(TAGE_SIZE, sizeof(TageEntry));
+    assert(tage[i]);
+    // tags are never 0xffff, so every entry starts unmatched
+    for (uint32_t j = 0; j < TAGE_SIZE; j ++) tage[i][j].tag = 0xffff;
+  }
+#endif
+  atexit(bpred_report);
+}
@@ -16,6 +16,9 @@
 #include <cpu/cpu.h>
 #include <cpu/decode.h>
 #include <cpu/difftest.h>
+#include <cpu/perf.h>
+#include <cpu/plugin.h>
+#include <device/event.h>
 #include <locale.h>
 #include <utils.h>
 /* The assembly code of instructions executed is only output to the screen
@@ -27,15 +30,15 @@
 
 CPU_state cpu = {};
 uint64_t g_nr_guest_inst = 0;
+PerfCounter g_perf = {};
 static uint64_t g_timer = 0; // unit: us
 static bool g_print_step = false;
 
-void device_update();
 // 扫描监视点
 extern void scan_wp();
 static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
 
-#ifdef CONFIG_ITRACE_COND
+#if defined(CONFIG_ITRACE_COND) && !defined(CONFIG_ITRACE_BINARY)
   // printf("%s\n", _this->logbuf);
   if (ITRACE_COND) {
     log_write("%s\n", _this->logbuf);
@@ -59,6 +62,19 @@ static void exec_once(Decode *s, vaddr_t pc) {
 
   // itrace
 #ifdef CONFIG_ITRACE
+#ifdef CONFIG_ITRACE_BINARY
+  if (ITRACE_COND) {
+    void itrace_bin_write(vaddr_t pc, uint32_t inst, word_t rd);
+    itrace_bin_write(s->pc, s->isa.inst.val,
+        MUXDEF(CONFIG_ITRACE_BINARY_RD, isa_inst_rd_val(s), 0));
+  }
+#endif
+  // the text line is only needed for the log or for single-stepping
+#ifdef CONFIG_ITRACE_BINARY
+  if (!g_print_step) return;
+#else
+  if (!g_print_step && !(ITRACE_COND)) return;
+#endif
   char *p = s->logbuf;
   p += snprintf(p, sizeof(s->logbuf), FMT_WORD ":", s->pc);
   int ilen = s->snpc - s->pc;
@@ -90,13 +106,23 @@ static void execute(uint64_t n) {
   Decode s;
 
   for (; n > 0; n--) {
+    IFDEF(CONFIG_PLUGIN, if (plugin_on(PLUGIN_BLOCK)) plugin_block(cpu.pc));
     exec_once(&s, cpu.pc);
     g_nr_guest_inst++;
+    IFDEF(CONFIG_PLUGIN, if (plugin_on(PLUGIN_INST)) plugin_inst(&s));
+    IFDEF(CONFIG_PROFILER, if (g_nr_guest_inst >= g_prof_next) profile_sample(cpu.pc));
     trace_and_difftest(&s, cpu.pc);
     if (nemu_state.state != NEMU_RUNNING) {
       break;
     }
-    IFDEF(CONFIG_DEVICE, device_update());
+    IFDEF(CONFIG_DEVICE, if (g_nr_guest_inst >= __atomic_load_n(&g_next_event, __ATOMIC_RELAXED)) event_run());
+    if (unlikely(isa_has_intr())) {
+      word_t intr = isa_query_intr();
+      if (intr != INTR_EMPTY) {
+        cpu.pc = isa_raise_intr(intr, cpu.pc);
+        IFDEF(CONFIG_DIFFTEST, ref_difftest_raise_intr(intr));
+      }
+    }
   }
 }
 
@@ -0,0 +1,135 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/perf.h>
+#include <cpu/plugin.h>
+#include <memory/paddr.h>
+#include <dlfcn.h>
+
+// Callbacks are kept per event class, and `g_plugin_mask' tells the call
+// sites which classes have any, so an unused class costs one branch.
+
+#define MAX_CB 16
+
+enum { EV_INST, EV_MEM, EV_BLOCK, EV_TRAP, EV_EXIT, NR_EV }; // in the order of PLUGIN_*
+
+typedef struct {
+  void *cb;
+  void *udata;
+} PluginCB;
+
+uint32_t g_plugin_mask = 0;
+static PluginCB cbs[NR_EV][MAX_CB];
+static int nr_cb[NR_EV] = {};
+static vaddr_t block_next = -1; // where the control flow falls through to
+
+#define call_cbs(ev, type, ...) do { \
+  for (int i = 0; i < nr_cb[ev]; i ++) ((type)cbs[ev][i].cb)(cbs[ev][i].udata, __VA_ARGS__); \
+} while (0)
+
+static void add_cb(int ev, void *cb, void *udata) {
+  Assert(nr_cb[ev] < MAX_CB, "Too many plugin callbacks of the same kind");
+  cbs[ev][nr_cb[ev] ++] = (PluginCB) { .cb = cb, .udata = udata };
+  if (ev != EV_EXIT) g_plugin_mask |= 1u << ev;
+  // blocks are found by plugin_inst() recording the fall-through pc
+  if (ev == EV_BLOCK) g_plugin_mask |= PLUGIN_INST;
+}
+
+void plugin_inst(Decode *s) {
+  block_next = s->snpc;
+  call_cbs(EV_INST, nemu_inst_cb_t, s->pc, (uint8_t *)&s->isa.inst.val, s->snpc - s->pc);
+}
+
+void plugin_block(vaddr_t pc) {
+  if (pc != block_next) call_cbs(EV_BLOCK, nemu_block_cb_t, pc);
+}
+
+void plugin_mem(int kind, vaddr_t addr, int len, word_t data) {
+  // a store passes the whole register, keep the bytes written
+  if (len < sizeof(word_t)) data &= (1ull << (len * 8)) - 1;
+  call_cbs(EV_MEM, nemu_mem_cb_t, cpu.pc, addr, len, kind, data);
+}
+
+void plugin_trap(vaddr_t pc, word_t cause, vaddr_t handler) {
+  call_cbs(EV_TRAP, nemu_trap_cb_t, pc, cause, handler);
+}
+
+static void plugin_exit() {
+  call_cbs(EV_EXIT, nemu_exit_cb_t, nemu_state.state, nemu_state.halt_ret, g_nr_guest_inst);
+}
+
+static void register_inst(nemu_inst_cb_t cb, void *udata) { add_cb(EV_INST, cb, udata); }
+static void register_mem(nemu_mem_cb_t cb, void *udata) { add_cb(EV_MEM, cb, udata); }
+static void register_block(nemu_block_cb_t cb, void *udata) { add_cb(EV_BLOCK, cb, udata); }
+static void register_trap(nemu_trap_cb_t cb, void *udata) { add_cb(EV_TRAP, cb, udata); }
+static void register_exit(nemu_exit_cb_t cb, void *udata) { add_cb(EV_EXIT, cb, udata); }
+
+static uint64_t read_reg(const char *name, bool *success) {
+  if (strcmp(name, "pc") == 0) { *success = true; return cpu.pc; }
+  *success = false;
+  return isa_reg_str2val(name, success);
+}
+
+static bool read_mem(uint64_t paddr, void *buf, size_t len) {
+  if (len == 0) return true;
+  if (!in_pmem(paddr) || !in_pmem(paddr + len - 1) || paddr + len - 1 < paddr) return false;
+  memcpy(buf, guest_to_host(paddr), len);
+  return true;
+}
+
+static uint64_t nr_inst() { return g_nr_guest_inst; }
+
+static const NemuPluginAPI api = {
+  .version = NEMU_PLUGIN_VERSION,
+  .isa = str(__GUEST_ISA__),
+  .register_inst = register_inst,
+  .register_mem = register_mem,
+  .register_block = register_block,
+  .register_trap = register_trap,
+  .register_exit = register_exit,
+  .read_reg = read_reg,
+  .read_mem = read_mem,
+  .nr_inst = nr_inst,
+};
+
+// spec is "lib.so" or "lib.so,args"
+void load_plugin(const char *spec) {
+  static bool exit_registered = false;
+  char *path = strdup(spec); // the plugin may keep the args
+  assert(path);
+  char *args = strchr(path, ',');
+  if (args != NULL) *args ++ = '\0';
+  else args = "";
+
+  void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  Assert(handle, "Can not load plugin %s: %s", path, dlerror());
+  const uint32_t *version = dlsym(handle, "nemu_plugin_version");
+  Assert(version, "%s does not export nemu_plugin_version", path);
+  Assert(*version == NEMU_PLUGIN_VERSION, "%s is built for plugin API version %u, NEMU has %u",
+      path, *version, NEMU_PLUGIN_VERSION);
+  int (*install)(const NemuPluginAPI *, const char *) = dlsym(handle, "nemu_plugin_install");
+  Assert(install, "%s does not export nemu_plugin_install", path);
+  // Assert() evaluates its condition again on failure, so call once
+  int ret = install(&api, args);
+  Assert(ret == 0, "Plugin %s failed to install with '%s'", path, args);
+
+  if (!exit_registered) {
+    atexit(plugin_exit);
+    exit_registered = true;
+  }
+  Log("Plugin %s is loaded", path);
+}
@@ -15,37 +15,72 @@
 
 #include <common.h>
 #include <device/alarm.h>
-#include <sys/time.h>
-#include <signal.h>
+#include <device/event.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
-#define MAX_HANDLER 8
+// A thread waits for a periodic timerfd on CLOCK_MONOTONIC, so the alarm
+// keeps its rate while NEMU is blocked in SDL or host I/O. The thread only
+// sets `alarm_pending` and kicks the event scheduler, and the handlers run
+// in the CPU thread at the next instruction boundary, not in signal
+// context.
 
-static alarm_handler_t handler[MAX_HANDLER] = {};
-static int idx = 0;
+static alarm_handler_t *handler = NULL;
+static int nr_handler = 0;
+static atomic_bool alarm_pending = false;
 
 void add_alarm_handle(alarm_handler_t h) {
-  assert(idx < MAX_HANDLER);
-  handler[idx ++] = h;
+  handler = realloc(handler, sizeof(handler[0]) * (nr_handler + 1));
+  assert(handler);
+  handler[nr_handler ++] = h;
 }
 
-static void alarm_sig_handler(int signum) {
-  int i;
-  for (i = 0; i < idx; i ++) {
+bool alarm_check_pending() {
+  return atomic_load(&alarm_pending);
+}
+
+void alarm_dispatch() {
+  if (!atomic_exchange(&alarm_pending, false)) return;
+  for (int i = 0; i < nr_handler; i ++) {
     handler[i]();
   }
 }
 
+static void *alarm_thread(void *arg) {
+  int tfd = *(int *)arg;
+  int epfd = epoll_create1(0);
+  assert(epfd >= 0);
+  struct epoll_event ev = { .events = EPOLLIN, .data.fd = tfd };
+  int ret = epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+  assert(ret == 0);
+  while (true) {
+    if (epoll_wait(epfd, &ev, 1, -1) <= 0) continue;
+    uint64_t nr_expire;
+    if (read(tfd, &nr_expire, sizeof(nr_expire)) != sizeof(nr_expire)) continue;
+    atomic_store(&alarm_pending, true);
+    event_kick();
+  }
+  return NULL;
+}
+
 void init_alarm() {
-  struct sigaction s;
-  memset(&s, 0, sizeof(s));
-  s.sa_handler = alarm_sig_handler;
-  int ret = sigaction(SIGVTALRM, &s, NULL);
-  Assert(ret == 0, "Can not set signal handler");
+  if (nr_handler == 0) return;
+  static int tfd = -1;
+  tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  Assert(tfd >= 0, "Can not create timerfd");
 
-  struct itimerval it = {};
+  struct itimerspec it = {};
   it.it_value.tv_sec = 0;
-  it.it_value.tv_usec = 1000000 / TIMER_HZ;
+  it.it_value.tv_nsec = 1000000000 / TIMER_HZ;
   it.it_interval = it.it_value;
-  ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
+  int ret = timerfd_settime(tfd, 0, &it, NULL);
   Assert(ret == 0, "Can not set timer");
+
+  pthread_t tid;
+  ret = pthread_create(&tid, NULL, alarm_thread, &tfd);
+  assert(ret == 0);
+  pthread_detach(tid);
 }
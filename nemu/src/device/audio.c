@@ -16,6 +16,7 @@
 #include <common.h>
 #include <device/map.h>
 #include <SDL2/SDL.h>
+#include <stdatomic.h>
 
 enum {
   reg_freq,
@@ -30,7 +31,143 @@ enum {
 static uint8_t *sbuf = NULL;
 static uint32_t *audio_base = NULL;
 
+// The stream buffer is a single-producer/single-consumer ring.
+// The guest (CPU thread) is the producer: it fills the free space of `sbuf`
+// starting from its own write position, then writes the number of bytes
+// filled to `reg_count` to commit them. The SDL audio callback thread is
+// the consumer. Reading `reg_count` returns the number of pending bytes.
+// Positions run in [0, 2 * CONFIG_SB_SIZE) to tell a full ring from an
+// empty one.
+#define SB_WRAP (2 * CONFIG_SB_SIZE)
+static atomic_uint sb_head = 0; // advanced by the consumer
+static atomic_uint sb_tail = 0; // advanced by the producer
+
+static uint32_t sb_count(uint32_t head, uint32_t tail) {
+  return (tail + SB_WRAP - head) % SB_WRAP;
+}
+
+// copy `len` bytes starting from position `pos` out of the ring
+static void sb_copy_out(uint8_t *dst, uint32_t pos, uint32_t len) {
+  uint32_t off = pos % CONFIG_SB_SIZE;
+  uint32_t n = (len < CONFIG_SB_SIZE - off ? len : CONFIG_SB_SIZE - off);
+  memcpy(dst, sbuf + off, n);
+  memcpy(dst + n, sbuf, len - n);
+}
+
+#ifdef CONFIG_AUDIO_WAV
+static FILE *wav_fp = NULL;
+static uint32_t wav_data_size = 0;
+
+static void wav_write_header() {
+  uint32_t freq = audio_base[reg_freq], channels = audio_base[reg_channels];
+  struct {
+    char riff[4]; uint32_t riff_size; char wave[4];
+    char fmt[4]; uint32_t fmt_size; uint16_t format, channels;
+    uint32_t freq, byte_rate; uint16_t block_align, bits;
+    char data[4]; uint32_t data_size;
+  } __attribute__((packed)) h = {
+    .riff = "RIFF", .riff_size = 36 + wav_data_size, .wave = "WAVE",
+    .fmt = "fmt ", .fmt_size = 16, .format = 1, .channels = channels,
+    .freq = freq, .byte_rate = freq * channels * 2,
+    .block_align = channels * 2, .bits = 16,
+    .data = "data", .data_size = wav_data_size,
+  };
+  fwrite(&h, sizeof(h), 1, wav_fp);
+}
+
+static void wav_close() {
+  // fix up the sizes in the header if the file is seekable
+  if (fseek(wav_fp, 0, SEEK_SET) == 0) wav_write_header();
+  fclose(wav_fp);
+  wav_fp = NULL;
+}
+
+static void audio_open() {
+  // the guest starts filling the ring from the beginning again
+  atomic_store(&sb_head, 0);
+  atomic_store(&sb_tail, 0);
+  if (wav_fp != NULL) return;
+  const char *path = CONFIG_AUDIO_WAV_PATH;
+  wav_fp = fopen(path, "w");
+  Assert(wav_fp, "Can not open '%s'", path);
+  wav_write_header();
+  atexit(wav_close);
+  Log("Audio is written to %s", path);
+}
+
+// there is no consumer thread, drain the ring in place
+static void audio_commit() {
+  static uint8_t buf[CONFIG_SB_SIZE];
+  uint32_t head = atomic_load(&sb_head), tail = atomic_load(&sb_tail);
+  uint32_t n = sb_count(head, tail);
+  sb_copy_out(buf, head, n);
+  fwrite(buf, n, 1, wav_fp);
+  wav_data_size += n;
+  atomic_store(&sb_head, tail);
+}
+#else
+static void audio_play(void *userdata, uint8_t *stream, int len) {
+  uint32_t head = atomic_load_explicit(&sb_head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&sb_tail, memory_order_acquire);
+  uint32_t n = sb_count(head, tail);
+  if (n > len) n = len;
+  sb_copy_out(stream, head, n);
+  // play silence on underrun
+  memset(stream + n, 0, len - n);
+  atomic_store_explicit(&sb_head, (head + n) % SB_WRAP, memory_order_release);
+}
+
+static void audio_open() {
+  SDL_AudioSpec s = {};
+  s.freq = audio_base[reg_freq];
+  s.format = AUDIO_S16SYS;
+  s.channels = audio_base[reg_channels];
+  s.samples = audio_base[reg_samples];
+  s.callback = audio_play;
+  s.userdata = NULL;
+
+  SDL_CloseAudio();
+  atomic_store(&sb_head, 0);
+  atomic_store(&sb_tail, 0);
+  int ret = SDL_InitSubSystem(SDL_INIT_AUDIO);
+  if (ret == 0) ret = SDL_OpenAudio(&s, NULL);
+  if (ret == 0) SDL_PauseAudio(0);
+  else Log("Can not open audio: %s", SDL_GetError());
+}
+
+static void audio_commit() {}
+#endif
+
 static void audio_io_handler(uint32_t offset, int len, bool is_write) {
+  assert(len == 4 && offset % 4 == 0);
+  switch (offset / 4) {
+    case reg_init:
+      if (is_write && audio_base[reg_init]) {
+        audio_open();
+        audio_base[reg_init] = 0;
+      }
+      break;
+    case reg_count: {
+      uint32_t head = atomic_load_explicit(&sb_head, memory_order_acquire);
+      uint32_t tail = atomic_load_explicit(&sb_tail, memory_order_relaxed);
+      uint32_t count = sb_count(head, tail);
+      if (is_write) {
+        uint32_t n = audio_base[reg_count];
+        if (n > CONFIG_SB_SIZE - count) {
+          Log("audio stream buffer overflow: %u bytes committed, but only %u bytes are free",
+              n, CONFIG_SB_SIZE - count);
+          n = CONFIG_SB_SIZE - count;
+        }
+        atomic_store_explicit(&sb_tail, (tail + n) % SB_WRAP, memory_order_release);
+        audio_commit();
+      } else {
+        audio_base[reg_count] = count;
+      }
+      break;
+    }
+    case reg_sbuf_size: audio_base[reg_sbuf_size] = CONFIG_SB_SIZE; break;
+    default: break;
+  }
 }
 
 void init_audio() {
@@ -41,6 +178,9 @@ void init_audio() {
 #else
   add_mmio_map("audio", CONFIG_AUDIO_CTL_MMIO, audio_base, space_size, audio_io_handler);
 #endif
+  audio_base[reg_sbuf_size] = CONFIG_SB_SIZE;
+  audio_base[reg_init] = 0;
+  audio_base[reg_count] = 0;
 
   sbuf = (uint8_t *)new_space(CONFIG_SB_SIZE);
   add_mmio_map("audio-sbuf", CONFIG_SB_ADDR, sbuf, CONFIG_SB_SIZE, NULL);
@@ -0,0 +1,136 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <device/blkimg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The image is mmap()ed. In overlay mode it is mapped read-only, so many
+// NEMU instances can share one image through the page cache. Written
+// blocks are copied to a sparse temporary file at the same offsets, and
+// a bitmap records which blocks live there. The delta is unlinked right
+// after it is created, so it is gone when NEMU exits and every run starts
+// from the pristine image.
+
+#define BLK_SHIFT 9
+#define BLK_SIZE (1u << BLK_SHIFT)
+
+struct BlkImg {
+  uint8_t *base;
+  uint8_t *delta;
+  uint64_t *dirty;
+  uint64_t size;
+};
+
+static inline bool is_dirty(BlkImg *img, uint64_t blk) {
+  return (img->dirty[blk / 64] >> (blk % 64)) & 1;
+}
+
+static inline void set_dirty(BlkImg *img, uint64_t blk) {
+  img->dirty[blk / 64] |= 1ull << (blk % 64);
+}
+
+static void init_delta(BlkImg *img) {
+  char path[] = "/tmp/nemu-delta-XXXXXX";
+  int fd = mkstemp(path);
+  Assert(fd >= 0, "Can not create the overlay of disk image");
+  unlink(path);
+  int ret = ftruncate(fd, img->size);
+  assert(ret == 0);
+  img->delta = mmap(NULL, img->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  Assert(img->delta != MAP_FAILED, "Can not mmap the overlay of disk image");
+  close(fd);
+  uint64_t nr_blk = (img->size + BLK_SIZE - 1) >> BLK_SHIFT;
+  img->dirty = calloc((nr_blk + 63) / 64, sizeof(img->dirty[0]));
+  assert(img->dirty);
+}
+
+BlkImg *blkimg_open(const char *path, bool overlay) {
+  if (path[0] == '\0') return NULL;
+  int fd = open(path, overlay ? O_RDONLY : O_RDWR);
+  if (fd < 0) return NULL;
+  struct stat st;
+  int ret = fstat(fd, &st);
+  assert(ret == 0);
+
+  BlkImg *img = calloc(1, sizeof(BlkImg));
+  assert(img);
+  img->size = st.st_size;
+  if (img->size > 0) {
+    int prot = PROT_READ | (overlay ? 0 : PROT_WRITE);
+    img->base = mmap(NULL, img->size, prot, MAP_SHARED, fd, 0);
+    Assert(img->base != MAP_FAILED, "Can not mmap disk image %s", path);
+    if (overlay) init_delta(img);
+  }
+  close(fd);
+  return img;
+}
+
+uint64_t blkimg_size(BlkImg *img) {
+  return img->size;
+}
+
+// the caller is responsible for keeping [off, off + len) inside the image
+
+void blkimg_read(BlkImg *img, uint64_t off, void *buf, uint64_t len) {
+  if (img->dirty == NULL) {
+    memcpy(buf, img->base + off, len);
+    return;
+  }
+  uint8_t *p = buf;
+  uint64_t end = off + len;
+  while (off < end) {
+    // copy the longest run of blocks coming from the same file
+    uint64_t blk = off >> BLK_SHIFT;
+    bool dirty = is_dirty(img, blk);
+    uint64_t next = (blk + 1) << BLK_SHIFT;
+    while (next < end && is_dirty(img, next >> BLK_SHIFT) == dirty) next += BLK_SIZE;
+    uint64_t n = (next < end ? next : end) - off;
+    memcpy(p, (dirty ? img->delta : img->base) + off, n);
+    p += n;
+    off += n;
+  }
+}
+
+void blkimg_write(BlkImg *img, uint64_t off, const void *buf, uint64_t len) {
+  if (img->dirty == NULL) {
+    memcpy(img->base + off, buf, len);
+    return;
+  }
+  if (len == 0) return;
+  uint64_t first = off >> BLK_SHIFT, last = (off + len - 1) >> BLK_SHIFT;
+  for (uint64_t blk = first; blk <= last; blk ++) {
+    if (is_dirty(img, blk)) continue;
+    uint64_t blk_off = blk << BLK_SHIFT;
+    bool partial = (blk_off < off) || (blk_off + BLK_SIZE > off + len);
+    if (partial) {
+      // keep the bytes of the block not covered by this write
+      uint64_t n = img->size - blk_off;
+      memcpy(img->delta + blk_off, img->base + blk_off, n < BLK_SIZE ? n : BLK_SIZE);
+    }
+    set_dirty(img, blk);
+  }
+  memcpy(img->delta + off, buf, len);
+}
+
+void blkimg_prefetch(BlkImg *img, uint64_t off, uint64_t len) {
+  if (off >= img->size) return;
+  if (len > img->size - off) len = img->size - off;
+  uint64_t start = ROUNDDOWN(off, sysconf(_SC_PAGESIZE));
+  madvise(img->base + start, off + len - start, MADV_WILLNEED);
+}
@@ -15,9 +15,12 @@
 
 #include <common.h>
 #include <utils.h>
+#include <device/map.h>
 #include <device/alarm.h>
+#include <device/event.h>
 #ifndef CONFIG_TARGET_AM
 #include <SDL2/SDL.h>
+#include <stdatomic.h>
 #endif
 
 void init_map();
@@ -28,27 +31,50 @@ void init_i8042();
 void init_audio();
 void init_disk();
 void init_sdcard();
+void init_virtio_blk();
+void init_virtio_console();
+void init_dma();
+void init_nic();
+void init_perf();
 void init_alarm();
 
 void send_key(uint8_t, bool);
 void vga_update_screen();
+void serial_update();
 
-void device_update() {
-  static uint64_t last = 0;
-  uint64_t now = get_time();
-  if (now - last < 1000000 / TIMER_HZ) {
-    return;
-  }
-  last = now;
+#ifndef CONFIG_TARGET_AM
+// SDL events are polled by the render thread if it is enabled, while the
+// devices are only accessed by the CPU thread. Events are passed from the
+// former to the latter through this single-producer/single-consumer queue.
+#define EVENT_QUEUE_LEN 256
+#define EVENT_KEYDOWN 0x100
 
-  IFDEF(CONFIG_HAS_VGA, vga_update_screen());
+static uint16_t event_queue[EVENT_QUEUE_LEN] = {};
+static atomic_uint event_f = 0, event_r = 0;
+static atomic_bool event_quit = false;
 
-#ifndef CONFIG_TARGET_AM
+static void event_enqueue(uint16_t ev) {
+  unsigned r = atomic_load_explicit(&event_r, memory_order_relaxed);
+  unsigned next = (r + 1) % EVENT_QUEUE_LEN;
+  if (next == atomic_load_explicit(&event_f, memory_order_acquire)) return; // drop when full
+  event_queue[r] = ev;
+  atomic_store_explicit(&event_r, next, memory_order_release);
+}
+
+static bool event_dequeue(uint16_t *ev) {
+  unsigned f = atomic_load_explicit(&event_f, memory_order_relaxed);
+  if (f == atomic_load_explicit(&event_r, memory_order_acquire)) return false;
+  *ev = event_queue[f];
+  atomic_store_explicit(&event_f, (f + 1) % EVENT_QUEUE_LEN, memory_order_release);
+  return true;
+}
+
+void sdl_poll_events() {
   SDL_Event event;
   while (SDL_PollEvent(&event)) {
     switch (event.type) {
       case SDL_QUIT:
-        nemu_state.state = NEMU_QUIT;
+        atomic_store(&event_quit, true);
         break;
 #ifdef CONFIG_HAS_KEYBOARD
       // If a key was pressed
@@ -56,26 +82,71 @@ void device_update() {
       case SDL_KEYUP: {
         uint8_t k = event.key.keysym.scancode;
         bool is_keydown = (event.key.type == SDL_KEYDOWN);
-        send_key(k, is_keydown);
+        event_enqueue(k | (is_keydown ? EVENT_KEYDOWN : 0));
         break;
       }
 #endif
       default: break;
     }
   }
+}
 #endif
+
+#ifndef CONFIG_TARGET_AM
+static void sdl_update() {
+  IFNDEF(CONFIG_VGA_RENDER_THREAD, sdl_poll_events());
+  if (atomic_exchange(&event_quit, false)) {
+    nemu_state.state = NEMU_QUIT;
+  }
+  uint16_t ev;
+  while (event_dequeue(&ev)) {
+    IFDEF(CONFIG_HAS_KEYBOARD, send_key(ev & 0xff, ev & EVENT_KEYDOWN));
+  }
 }
+#endif
 
 void sdl_clear_event_queue() {
 #ifndef CONFIG_TARGET_AM
-  SDL_Event event;
-  while (SDL_PollEvent(&event));
+  IFNDEF(CONFIG_VGA_RENDER_THREAD, sdl_poll_events());
+  uint16_t ev;
+  while (event_dequeue(&ev));
+  atomic_store(&event_quit, false);
+#endif
+}
+
+// bits of the device list, the same as in AM
+enum {
+  DEV_SERIAL = 0x001, DEV_TIMER = 0x002, DEV_KEYBOARD = 0x004, DEV_VGA = 0x008,
+  DEV_AUDIO = 0x010, DEV_DISK = 0x020, DEV_SDCARD = 0x040, DEV_VIRTIO = 0x080,
+  DEV_DMA = 0x100, DEV_NIC = 0x200, DEV_PERF = 0x400,
+};
+
+static uint32_t *devlist_base = NULL;
+
+static void devlist_io_handler(uint32_t offset, int len, bool is_write) {
+  // read-only, a write is undone
+  *devlist_base = 0 IFDEF(CONFIG_HAS_SERIAL, | DEV_SERIAL) IFDEF(CONFIG_HAS_TIMER, | DEV_TIMER)
+    IFDEF(CONFIG_HAS_KEYBOARD, | DEV_KEYBOARD) IFDEF(CONFIG_HAS_VGA, | DEV_VGA)
+    IFDEF(CONFIG_HAS_AUDIO, | DEV_AUDIO) IFDEF(CONFIG_HAS_DISK, | DEV_DISK)
+    IFDEF(CONFIG_HAS_SDCARD, | DEV_SDCARD) IFDEF(CONFIG_HAS_VIRTIO, | DEV_VIRTIO)
+    IFDEF(CONFIG_HAS_DMA, | DEV_DMA) IFDEF(CONFIG_HAS_NIC, | DEV_NIC)
+    IFDEF(CONFIG_HAS_PERF, | DEV_PERF);
+}
+
+static void init_devlist() {
+  devlist_base = (uint32_t *)new_space(4);
+  devlist_io_handler(0, 4, false);
+#ifdef CONFIG_HAS_PORT_IO
+  add_pio_map ("devlist", CONFIG_DEVLIST_PORT, devlist_base, 4, devlist_io_handler);
+#else
+  add_mmio_map("devlist", CONFIG_DEVLIST_MMIO, devlist_base, 4, devlist_io_handler);
 #endif
 }
 
 void init_device() {
   IFDEF(CONFIG_TARGET_AM, ioe_init());
   init_map();
+  init_devlist();
 
   IFDEF(CONFIG_HAS_SERIAL, init_serial());
   IFDEF(CONFIG_HAS_TIMER, init_timer());
@@ -84,6 +155,15 @@ void init_device() {
   IFDEF(CONFIG_HAS_AUDIO, init_audio());
   IFDEF(CONFIG_HAS_DISK, init_disk());
   IFDEF(CONFIG_HAS_SDCARD, init_sdcard());
+  IFDEF(CONFIG_HAS_VIRTIO, init_virtio_blk());
+  IFDEF(CONFIG_HAS_VIRTIO, init_virtio_console());
+  IFDEF(CONFIG_HAS_DMA, init_dma());
+  IFDEF(CONFIG_HAS_NIC, init_nic());
+  IFDEF(CONFIG_HAS_PERF, init_perf());
+
+  IFDEF(CONFIG_HAS_SERIAL, event_add("serial", 1000000 / TIMER_HZ, serial_update));
+  IFDEF(CONFIG_HAS_VGA, event_add("vga", 1000000 / TIMER_HZ, vga_update_screen));
+  IFNDEF(CONFIG_TARGET_AM, event_add("sdl", 1000000 / TIMER_HZ, sdl_update));
 
   IFNDEF(CONFIG_TARGET_AM, init_alarm());
 }
@@ -14,6 +14,92 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <device/blkimg.h>
+#include <memory/paddr.h>
+
+// A block device doing DMA. The guest sets up `reg_blkno`, `reg_blkcnt`
+// and `reg_buf` (the guest physical address of the buffer), then writes
+// a command to `reg_cmd`. The whole transfer is done by one memcpy()
+// between the mmap()ed image and the guest memory (split only where an
+// overlay image switches between the base image and the delta).
+
+#define BLKSZ 512
+
+enum {
+  reg_present,
+  reg_blksz,
+  reg_nr_blk,
+  reg_blkno,
+  reg_blkcnt,
+  reg_buf,
+  reg_cmd,
+  reg_status,
+  nr_reg
+};
+
+enum { DISK_CMD_NONE, DISK_CMD_READ, DISK_CMD_WRITE };
+enum { DISK_OK, DISK_ERROR };
+
+static uint32_t *disk_base = NULL;
+static BlkImg *img = NULL;
+static uint32_t nr_blk = 0;
+
+static bool disk_transfer(bool is_write) {
+  uint32_t blkno = disk_base[reg_blkno], blkcnt = disk_base[reg_blkcnt];
+  paddr_t buf = disk_base[reg_buf];
+  uint64_t len = (uint64_t)blkcnt * BLKSZ;
+  if (img == NULL || (uint64_t)blkno + blkcnt > nr_blk) return false;
+  if (len == 0) return true;
+  paddr_t end = buf + len - 1;
+  if (len > CONFIG_MSIZE || !in_pmem(buf) || !in_pmem(end) || end < buf) return false;
+
+  uint64_t off = (uint64_t)blkno * BLKSZ;
+  if (is_write) blkimg_write(img, off, guest_to_host(buf), len);
+  else {
+    blkimg_read(img, off, guest_to_host(buf), len);
+    IFDEF(CONFIG_DIFFTEST, ref_difftest_memcpy(buf, guest_to_host(buf), len, DIFFTEST_TO_REF));
+  }
+  return true;
+}
+
+static void disk_io_handler(uint32_t offset, int len, bool is_write) {
+  assert(len == 4 && offset % 4 == 0);
+  if (!is_write || offset / 4 != reg_cmd) return;
+  bool ok;
+  switch (disk_base[reg_cmd]) {
+    case DISK_CMD_READ:  ok = disk_transfer(false); break;
+    case DISK_CMD_WRITE: ok = disk_transfer(true); break;
+    default: ok = false; break;
+  }
+  disk_base[reg_status] = (ok ? DISK_OK : DISK_ERROR);
+  disk_base[reg_cmd] = DISK_CMD_NONE;
+}
+
+static void init_img(const char *path) {
+  if (path[0] == '\0') return;
+  img = blkimg_open(path, MUXDEF(CONFIG_DISK_IMG_OVERLAY, true, false));
+  if (img == NULL) {
+    Log("Can not find disk image: %s", path);
+    return;
+  }
+  nr_blk = blkimg_size(img) / BLKSZ;
+  Log("Disk image %s, %u blocks%s", path, nr_blk,
+      MUXDEF(CONFIG_DISK_IMG_OVERLAY, " (overlay)", ""));
+}
 
 void init_disk() {
+  uint32_t space_size = sizeof(uint32_t) * nr_reg;
+  disk_base = (uint32_t *)new_space(space_size);
+#ifdef CONFIG_HAS_PORT_IO
+  add_pio_map ("disk", CONFIG_DISK_CTL_PORT, disk_base, space_size, disk_io_handler);
+#else
+  add_mmio_map("disk", CONFIG_DISK_CTL_MMIO, disk_base, space_size, disk_io_handler);
+#endif
+
+  init_img(CONFIG_DISK_IMG_PATH);
+  disk_base[reg_present] = (img != NULL);
+  disk_base[reg_blksz] = BLKSZ;
+  disk_base[reg_nr_blk] = nr_blk;
+  disk_base[reg_cmd] = DISK_CMD_NONE;
+  disk_base[reg_status] = DISK_OK;
 }
@@ -0,0 +1,86 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <device/map.h>
+#include <device/mmio.h>
+#include <memory/paddr.h>
+
+// A copy engine. The guest sets up `reg_src`, `reg_dst` and `reg_len`,
+// selects an operation in `reg_op`, then writes to `reg_go`. The whole
+// transfer is done by one host memmove()/memset() before the write
+// returns, so the guest can use the result right away. Both ranges may
+// lie in pmem or in a device space without registers, such as the frame
+// buffer, but each must be contained in a single region.
+
+enum {
+  reg_src,
+  reg_dst,
+  reg_len,
+  reg_op,
+  reg_go,
+  reg_status,
+  nr_reg
+};
+
+enum { DMA_OP_COPY, DMA_OP_FILL }; // for DMA_OP_FILL, the byte is in `reg_src`
+enum { DMA_OK, DMA_ERROR };
+
+static uint32_t *dma_base = NULL;
+
+static uint8_t* dma_to_host(paddr_t addr, paddr_t len) {
+  if (in_pmem(addr)) {
+    return (in_pmem(addr + len - 1) && addr + len - 1 >= addr ? guest_to_host(addr) : NULL);
+  }
+  return mmio_to_host(addr, len);
+}
+
+static bool dma_transfer() {
+  paddr_t src = dma_base[reg_src], dst = dma_base[reg_dst], len = dma_base[reg_len];
+  if (len == 0) return true;
+  uint8_t *hdst = dma_to_host(dst, len);
+  if (hdst == NULL) return false;
+
+  switch (dma_base[reg_op]) {
+    case DMA_OP_COPY: {
+      uint8_t *hsrc = dma_to_host(src, len);
+      if (hsrc == NULL) return false;
+      memmove(hdst, hsrc, len);
+      break;
+    }
+    case DMA_OP_FILL: memset(hdst, (uint8_t)src, len); break;
+    default: return false;
+  }
+
+  // the REF only models pmem, and device spaces are never compared
+  IFDEF(CONFIG_DIFFTEST, if (in_pmem(dst)) ref_difftest_memcpy(dst, hdst, len, DIFFTEST_TO_REF));
+  return true;
+}
+
+static void dma_io_handler(uint32_t offset, int len, bool is_write) {
+  assert(len == 4 && offset % 4 == 0);
+  if (!is_write || offset / 4 != reg_go) return;
+  dma_base[reg_status] = (dma_transfer() ? DMA_OK : DMA_ERROR);
+}
+
+void init_dma() {
+  uint32_t space_size = sizeof(uint32_t) * nr_reg;
+  dma_base = (uint32_t *)new_space(space_size);
+#ifdef CONFIG_HAS_PORT_IO
+  add_pio_map ("dma", CONFIG_DMA_CTL_PORT, dma_base, space_size, dma_io_handler);
+#else
+  add_mmio_map("dma", CONFIG_DMA_CTL_MMIO, dma_base, space_size, dma_io_handler);
+#endif
+  dma_base[reg_status] = DMA_OK;
+}
@@ -0,0 +1,145 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <device/event.h>
+#include <device/alarm.h>
+#include <utils.h>
+
+// Periodic events kept in a min-heap ordered by their deadlines, which
+// are counted in guest instructions. Periods are given in microseconds
+// and converted with the instruction rate of NEMU, which is measured
+// against the host clock whenever events are run. In icount mode the rate
+// is fixed by CONFIG_ICOUNT_MIPS instead.
+//
+// The deadlines are compared with a virtual clock, which is the number of
+// retired instructions plus those skipped by event_idle(). An idle guest
+// then jumps straight to the next deadline instead of spinning on the
+// timer for real.
+
+#define MAX_EVENT 16
+#define INIT_INST_PER_SEC MUXDEF(CONFIG_ICOUNT, CONFIG_ICOUNT_MIPS * 1000000ull, 10000000)
+// samples over a longer interval are dropped, the guest was probably
+// stopped by the debugger in the middle
+#define CALIBRATE_MIN_US 10000
+#define CALIBRATE_MAX_US 1000000
+
+typedef struct {
+  const char *name;
+  uint64_t period_us;
+  uint64_t deadline;
+  event_handler_t handler;
+} Event;
+
+static Event events[MAX_EVENT] = {};
+static int heap[MAX_EVENT] = {};
+static int nr_event = 0;
+static uint64_t inst_per_sec = INIT_INST_PER_SEC;
+static uint64_t vclock_skip = 0;
+uint64_t g_next_event = UINT64_MAX;
+
+extern uint64_t g_nr_guest_inst;
+
+#define VCLOCK() (g_nr_guest_inst + vclock_skip)
+
+#define DEADLINE(i) (events[heap[i]].deadline)
+
+static void heap_swap(int i, int j) {
+  int t = heap[i]; heap[i] = heap[j]; heap[j] = t;
+}
+
+static void sift_up(int i) {
+  while (i > 0 && DEADLINE(i) < DEADLINE((i - 1) / 2)) {
+    heap_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void sift_down(int i) {
+  while (true) {
+    int min = i, l = 2 * i + 1, r = 2 * i + 2;
+    if (l < nr_event && DEADLINE(l) < DEADLINE(min)) min = l;
+    if (r < nr_event && DEADLINE(r) < DEADLINE(min)) min = r;
+    if (min == i) break;
+    heap_swap(i, min);
+    i = min;
+  }
+}
+
+uint64_t event_us_to_inst(uint64_t us) {
+  uint64_t n = us * inst_per_sec / 1000000;
+  return (n > 0 ? n : 1);
+}
+
+static void calibrate() {
+#ifndef CONFIG_ICOUNT
+  static uint64_t last_us = 0, last_inst = 0;
+  uint64_t now = get_time();
+  uint64_t us = now - last_us;
+  if (us < CALIBRATE_MIN_US) return;
+  uint64_t inst = g_nr_guest_inst - last_inst;
+  if (us <= CALIBRATE_MAX_US && inst > 0) {
+    inst_per_sec = (inst_per_sec + inst * 1000000 / us) / 2;
+  }
+  last_us = now;
+  last_inst = g_nr_guest_inst;
+#endif
+}
+
+static void update_next_event() {
+  uint64_t next = (nr_event > 0 ? DEADLINE(0) - vclock_skip : UINT64_MAX);
+  __atomic_store_n(&g_next_event, next, __ATOMIC_SEQ_CST);
+  // do not lose a kick from the alarm thread racing with the store above
+  IFNDEF(CONFIG_TARGET_AM, if (alarm_check_pending()) event_kick());
+}
+
+void event_kick() {
+  __atomic_store_n(&g_next_event, 0, __ATOMIC_SEQ_CST);
+}
+
+uint64_t event_time_us() {
+  return MUXDEF(CONFIG_ICOUNT, VCLOCK() / CONFIG_ICOUNT_MIPS, get_time());
+}
+
+void event_idle() {
+  if (nr_event == 0) return;
+  uint64_t now = VCLOCK();
+  if (DEADLINE(0) > now) vclock_skip += DEADLINE(0) - now;
+  update_next_event();
+}
+
+void event_add(const char *name, uint64_t period_us, event_handler_t handler) {
+  assert(nr_event < MAX_EVENT);
+  int i = nr_event ++;
+  events[i] = (Event) {
+    .name = name, .period_us = period_us, .handler = handler,
+    .deadline = VCLOCK() + event_us_to_inst(period_us),
+  };
+  heap[i] = i;
+  sift_up(i);
+  update_next_event();
+}
+
+void event_run() {
+  IFNDEF(CONFIG_TARGET_AM, alarm_dispatch());
+  calibrate();
+  while (nr_event > 0 && DEADLINE(0) <= VCLOCK()) {
+    Event *e = &events[heap[0]];
+    e->deadline = VCLOCK() + event_us_to_inst(e->period_us);
+    sift_down(0);
+    e->handler();
+  }
+  update_next_event();
+}
@@ -16,4 +16,5 @@
 #include <isa.h>
 
 void dev_raise_intr() {
+  isa_dev_intr();
 }
@@ -14,7 +14,9 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <device/mmio.h>
 #include <memory/paddr.h>
+#include <cpu/perf.h>
 
 #define NR_MAP 16
 
@@ -53,11 +55,23 @@ void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_
   nr_map ++;
 }
 
+// host pointer to the device space backing [addr, addr + len), or NULL if
+// the range does not lie within a single map, or the map has a callback:
+// accessing its space directly would bypass the device registers
+void* mmio_to_host(paddr_t addr, paddr_t len) {
+  IOMap *map = fetch_mmio_map(addr);
+  if (map == NULL || map->callback != NULL) return NULL;
+  if (len == 0 || len - 1 > map->high - addr) return NULL;
+  return (uint8_t *)map->space + (addr - map->low);
+}
+
 /* bus interface */
 word_t mmio_read(paddr_t addr, int len) {
+  perf_count(mmio);
   return map_read(addr, len, fetch_mmio_map(addr));
 }
 
 void mmio_write(paddr_t addr, int len, word_t data) {
+  perf_count(mmio);
   map_write(addr, len, data, fetch_mmio_map(addr));
 }
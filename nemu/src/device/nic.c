@@ -0,0 +1,245 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#define _GNU_SOURCE  // for sendmmsg() and recvmmsg()
+#include <device/map.h>
+#include <memory/paddr.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// A simple NIC. The guest keeps two rings of descriptors in its memory
+// and tells the device where they are with `reg_{tx,rx}_base` and
+// `reg_{tx,rx}_size` (a power of 2). Every ring has two free-running
+// counters: `avail` is advanced by the guest after it has filled a TX
+// descriptor or posted an empty RX buffer, and `used` is advanced by
+// the device after it has sent the frame or filled the buffer (then the
+// length of the descriptor is set to the length of the frame).
+//
+// A write to `reg_doorbell` sends all pending TX frames with a single
+// sendmmsg(). Frames go through a SOCK_SEQPACKET socket, which keeps
+// frame boundaries. With CONFIG_NIC_SOCKET_PATH set, the first NEMU
+// instance listens on that path and the second one connects to it;
+// otherwise the NIC is looped back to itself through a socketpair().
+// A poller thread receives frames into a host queue, and they are
+// copied into the guest RX buffers by the CPU thread when the guest
+// rings the doorbell or reads `reg_rx_used`. A ring with a bad size or
+// out of pmem is not touched, and is reported in `reg_status`.
+
+typedef struct {
+  uint32_t addr;
+  uint32_t len;
+} NICDesc;
+
+enum {
+  reg_status,  // bit 0: link up, bit 1: bad ring
+  reg_tx_base,
+  reg_tx_size,
+  reg_tx_avail,
+  reg_tx_used,
+  reg_rx_base,
+  reg_rx_size,
+  reg_rx_avail,
+  reg_rx_used,
+  reg_doorbell,
+  nr_reg
+};
+
+#define NIC_RING_MAX 1024
+#define NIC_BATCH 64
+#define FRAME_MAX 16384
+#define RXQ_SIZE 256  // must be a power of 2
+
+static uint32_t *nic_base = NULL;
+static atomic_int sock_fd = -1;
+
+typedef struct {
+  uint32_t len;
+  uint8_t data[FRAME_MAX];
+} Frame;
+
+static Frame rxq[RXQ_SIZE];
+static atomic_uint rxq_f = 0, rxq_r = 0;
+
+// a ring of size 0 is not set up yet
+static bool nic_ring_ok(int base, int size) {
+  uint32_t n = nic_base[size];
+  if (n == 0) return true;
+  paddr_t end = nic_base[base] + n * sizeof(NICDesc) - 1;
+  return n <= NIC_RING_MAX && (n & (n - 1)) == 0 &&
+    in_pmem(nic_base[base]) && in_pmem(end) && end >= nic_base[base];
+}
+
+static NICDesc* nic_desc(int base, int size, uint32_t idx) {
+  paddr_t addr = nic_base[base] + (idx & (nic_base[size] - 1)) * sizeof(NICDesc);
+  return (NICDesc *)guest_to_host(addr);
+}
+
+static bool nic_buf_ok(NICDesc *d) {
+  paddr_t end = d->addr + d->len - 1;
+  return d->len > 0 && in_pmem(d->addr) && in_pmem(end) && end >= d->addr;
+}
+
+static void nic_tx() {
+  if (nic_base[reg_tx_size] == 0 || !nic_ring_ok(reg_tx_base, reg_tx_size)) return;
+  int fd = atomic_load_explicit(&sock_fd, memory_order_acquire);
+  while (nic_base[reg_tx_used] != nic_base[reg_tx_avail]) {
+    struct mmsghdr msgs[NIC_BATCH];
+    struct iovec iov[NIC_BATCH];
+    uint32_t pending = nic_base[reg_tx_avail] - nic_base[reg_tx_used];
+    int n = 0;
+    for (; n < NIC_BATCH && n < pending; n ++) {
+      NICDesc *d = nic_desc(reg_tx_base, reg_tx_size, nic_base[reg_tx_used] + n);
+      bool ok = nic_buf_ok(d) && d->len <= FRAME_MAX;
+      // a bad descriptor is sent as an empty frame, which the peer drops
+      iov[n] = (struct iovec) { .iov_base = ok ? guest_to_host(d->addr) : NULL, .iov_len = ok ? d->len : 0 };
+      msgs[n] = (struct mmsghdr) { .msg_hdr = { .msg_iov = &iov[n], .msg_iovlen = 1 } };
+    }
+    if (fd < 0) {
+      // no peer, the frames are lost as on an unplugged cable
+      nic_base[reg_tx_used] += n;
+      continue;
+    }
+    int sent = sendmmsg(fd, msgs, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent <= 0) {
+      // the peer is not keeping up, the remaining frames stay in the ring
+      // until the next doorbell; a dead peer is handled as no peer
+      if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) fd = -1;
+      else break;
+      continue;
+    }
+    nic_base[reg_tx_used] += sent;
+  }
+}
+
+static void nic_rx() {
+  if (nic_base[reg_rx_size] == 0 || !nic_ring_ok(reg_rx_base, reg_rx_size)) return;
+  unsigned f = atomic_load_explicit(&rxq_f, memory_order_relaxed);
+  unsigned r = atomic_load_explicit(&rxq_r, memory_order_acquire);
+  for (; f != r && nic_base[reg_rx_used] != nic_base[reg_rx_avail]; f = (f + 1) % RXQ_SIZE) {
+    Frame *fr = &rxq[f];
+    if (fr->len == 0) continue;
+    NICDesc *d = nic_desc(reg_rx_base, reg_rx_size, nic_base[reg_rx_used]);
+    uint32_t len = (nic_buf_ok(d) ? (fr->len < d->len ? fr->len : d->len) : 0);
+    memcpy(guest_to_host(d->addr), fr->data, len);
+    d->len = len;
+#ifdef CONFIG_DIFFTEST
+    ref_difftest_memcpy(d->addr, guest_to_host(d->addr), len, DIFFTEST_TO_REF);
+    ref_difftest_memcpy(host_to_guest((uint8_t *)d), d, sizeof(*d), DIFFTEST_TO_REF);
+#endif
+    nic_base[reg_rx_used] ++;
+  }
+  atomic_store_explicit(&rxq_f, f, memory_order_release);
+}
+
+static int nic_open(struct sockaddr_un *addr) {
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  Assert(fd >= 0, "Can not create NIC socket");
+  if (connect(fd, (struct sockaddr *)addr, sizeof(*addr)) == 0) {
+    Log("NIC connected to %s", addr->sun_path);
+    return fd;
+  }
+  // nobody is listening yet, so wait for the peer here
+  unlink(addr->sun_path);
+  bool ok = bind(fd, (struct sockaddr *)addr, sizeof(*addr)) == 0 && listen(fd, 1) == 0;
+  Assert(ok, "Can not listen on %s", addr->sun_path);
+  Log("NIC waiting for a peer on %s", addr->sun_path);
+  int conn = accept(fd, NULL, NULL);
+  Assert(conn >= 0, "Can not accept NIC peer");
+  close(fd);
+  unlink(addr->sun_path);
+  return conn;
+}
+
+static void *nic_poller(void *arg) {
+  int fd = (intptr_t)arg;
+  if (fd < 0) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, CONFIG_NIC_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    fd = nic_open(&addr);
+    atomic_store_explicit(&sock_fd, fd, memory_order_release);
+  }
+
+  struct mmsghdr msgs[NIC_BATCH];
+  struct iovec iov[NIC_BATCH];
+  while (true) {
+    unsigned r = atomic_load_explicit(&rxq_r, memory_order_relaxed);
+    unsigned used = r - atomic_load_explicit(&rxq_f, memory_order_acquire);
+    int space = (RXQ_SIZE - 1 - used % RXQ_SIZE);
+    if (space == 0) {
+      // wait for the guest rather than dropping frames, and let the
+      // socket push back on the sender
+      usleep(100);
+      continue;
+    }
+    // one batch never wraps around the queue
+    int n = (space < NIC_BATCH ? space : NIC_BATCH);
+    if (n > RXQ_SIZE - r) n = RXQ_SIZE - r;
+    for (int i = 0; i < n; i ++) {
+      iov[i] = (struct iovec) { .iov_base = rxq[r + i].data, .iov_len = FRAME_MAX };
+      msgs[i] = (struct mmsghdr) { .msg_hdr = { .msg_iov = &iov[i], .msg_iovlen = 1 } };
+    }
+    int got = recvmmsg(fd, msgs, n, MSG_WAITFORONE, NULL);
+    if (got <= 0) {
+      if (got < 0 && errno == EINTR) continue;
+      break;
+    }
+    for (int i = 0; i < got; i ++) rxq[r + i].len = msgs[i].msg_len;
+    atomic_store_explicit(&rxq_r, (r + got) % RXQ_SIZE, memory_order_release);
+  }
+
+  // keep the socket open so that a racing send() never hits a reused fd
+  Log("NIC peer disconnected");
+  atomic_store_explicit(&sock_fd, -1, memory_order_release);
+  return NULL;
+}
+
+static void nic_io_handler(uint32_t offset, int len, bool is_write) {
+  assert(len == 4 && offset % 4 == 0);
+  switch (offset / 4) {
+    case reg_doorbell: if (is_write) { nic_tx(); nic_rx(); } break;
+    case reg_rx_used: if (!is_write) nic_rx(); break;
+    case reg_status:
+      if (!is_write) {
+        bool bad = !nic_ring_ok(reg_tx_base, reg_tx_size) || !nic_ring_ok(reg_rx_base, reg_rx_size);
+        nic_base[reg_status] = (atomic_load(&sock_fd) >= 0) | (bad << 1);
+      }
+      break;
+  }
+}
+
+void init_nic() {
+  uint32_t space_size = sizeof(uint32_t) * nr_reg;
+  nic_base = (uint32_t *)new_space(space_size);
+  add_mmio_map("nic", CONFIG_NIC_CTL_MMIO, nic_base, space_size, nic_io_handler);
+
+  intptr_t peer = -1;
+  if (CONFIG_NIC_SOCKET_PATH[0] == '\0') {
+    int sv[2];
+    int ret = socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv);
+    Assert(ret == 0, "Can not create NIC socketpair");
+    atomic_store(&sock_fd, sv[0]);
+    peer = sv[1];
+    Log("NIC in loopback mode");
+  }
+
+  pthread_t tid;
+  int ret = pthread_create(&tid, NULL, nic_poller, (void *)peer);
+  assert(ret == 0);
+  pthread_detach(tid);
+}
@@ -0,0 +1,59 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <device/map.h>
+#include <cpu/perf.h>
+
+// Guest-visible event counters, each a 64-bit value split into a low
+// and a high word. As for the RTC, reading the high word latches the
+// whole counter, so the guest reads it first. The counters run from
+// reset; the guest measures a region by taking the difference.
+
+enum {
+  reg_inst,    // retired instructions
+  reg_load,
+  reg_store,
+  reg_branch,  // taken conditional branches
+  reg_mmio,
+  nr_reg
+};
+
+static uint32_t *perf_base = NULL;
+
+static uint64_t perf_read(int reg) {
+  switch (reg) {
+    case reg_inst:   return g_nr_guest_inst;
+    case reg_load:   return g_perf.load;
+    case reg_store:  return g_perf.store;
+    case reg_branch: return g_perf.branch;
+    case reg_mmio:   return g_perf.mmio;
+    default: panic("do not support offset = %d", reg * 8);
+  }
+}
+
+static void perf_io_handler(uint32_t offset, int len, bool is_write) {
+  assert(len == 4 && offset % 4 == 0);
+  if (is_write || offset % 8 != 4) return;
+  int reg = offset / 8;
+  uint64_t val = perf_read(reg);
+  perf_base[reg * 2] = (uint32_t)val;
+  perf_base[reg * 2 + 1] = val >> 32;
+}
+
+void init_perf() {
+  uint32_t space_size = sizeof(uint64_t) * nr_reg;
+  perf_base = (uint32_t *)new_space(space_size);
+  add_mmio_map("perf", CONFIG_PERF_CTL_MMIO, perf_base, space_size, perf_io_handler);
+}
@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <device/blkimg.h>
 #include "mmc.h"
 
 // http://www.files.e-shop.co.il/pdastore/Tech-mmc-samsung/SEC%20MMC%20SPEC%20ver09.pdf
@@ -40,19 +41,45 @@ enum {
   SDHBLC
 };
 
-static FILE *fp = NULL;
+// The image is mmap()ed, so SDDATA reads are served from the mapping
+// directly instead of stdio calls, and the page cache plays the role of
+// the block cache. Writes are collected into a block buffer and written
+// back a whole block at a time.
+#define SECTOR_SIZE 512
+
+static BlkImg *img = NULL;
+static uint64_t img_size = 0;
 static uint32_t *base = NULL;
 static uint32_t blkcnt = 0;
 static long blk_addr = 0;
 static uint32_t addr = 0;
 static bool write_cmd = 0;
 static bool read_ext_csd = false;
+static uint8_t wbuf[SECTOR_SIZE] = {};
 
 static void prepare_rw(int is_write) {
   blk_addr = base[SDARG];
   addr = 0;
-  if (fp) fseek(fp, blk_addr << 9, SEEK_SET);
   write_cmd = is_write;
+  if (img && !is_write) {
+    // prefetch the blocks to read, as announced by MMC_SET_BLOCK_COUNT
+    blkimg_prefetch(img, (uint64_t)blk_addr * SECTOR_SIZE,
+        (uint64_t)(blkcnt ? blkcnt : 1) * SECTOR_SIZE);
+  }
+}
+
+static void sdcard_read_data() {
+  uint64_t off = (uint64_t)blk_addr * SECTOR_SIZE + addr;
+  if (img && off + 4 <= img_size) blkimg_read(img, off, &base[SDDATA], 4);
+  else base[SDDATA] = 0;
+}
+
+static void sdcard_write_data() {
+  memcpy(wbuf + addr % SECTOR_SIZE, &base[SDDATA], 4);
+  if ((addr + 4) % SECTOR_SIZE != 0) return;
+  // the block is complete, write it back
+  uint64_t off = (uint64_t)blk_addr * SECTOR_SIZE + addr + 4 - SECTOR_SIZE;
+  if (img && off + SECTOR_SIZE <= img_size) blkimg_write(img, off, wbuf, SECTOR_SIZE);
 }
 
 static void sdcard_handle_cmd(int cmd) {
@@ -109,10 +136,10 @@ static void sdcard_io_handler(uint32_t offset, int len, bool is_write) {
          }
          base[SDDATA] = data;
          if (addr == 512 - 4) read_ext_csd = false;
-       } else if (fp) {
-         __attribute__((unused)) int ret;
-         if (!write_cmd) { ret = fread(&base[SDDATA], 4, 1, fp); }
-         else { ret = fwrite(&base[SDDATA], 4, 1, fp); }
+       } else if (!write_cmd) {
+         if (!is_write) sdcard_read_data();
+       } else {
+         if (is_write) sdcard_write_data();
        }
        addr += 4;
        break;
@@ -128,7 +155,11 @@ void init_sdcard() {
 
   Assert(C_SIZE < (1 << 12), "shoule be fit in 12 bits");
 
-  const char *img = CONFIG_SDCARD_IMG_PATH;
-  fp = fopen(img, "r+");
-  if (fp == NULL) Log("Can not find sdcard image: %s", img);
+  const char *path = CONFIG_SDCARD_IMG_PATH;
+  img = blkimg_open(path, MUXDEF(CONFIG_SDCARD_IMG_OVERLAY, true, false));
+  if (img == NULL) {
+    Log("Can not find sdcard image: %s", path);
+    return;
+  }
+  img_size = blkimg_size(img);
 }
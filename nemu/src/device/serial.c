@@ -13,33 +13,169 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
+#define _GNU_SOURCE  // for posix_openpt() and friends
 #include <utils.h>
 #include <device/map.h>
+#ifndef CONFIG_TARGET_AM
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#endif
 
 /* http://en.wikibooks.org/wiki/Serial_Programming/8250_UART_Programming */
 // NOTE: this is compatible to 16550
 
 #define CH_OFFSET 0
+#define LSR_OFFSET 5
+
+#define LSR_DR   0x01  // data ready
+#define LSR_THRE 0x20  // transmitter holding register empty
+#define LSR_TEMT 0x40  // transmitter empty
 
 static uint8_t *serial_base = NULL;
 
+#ifdef CONFIG_TARGET_AM
+static void serial_putc(char ch) { putch(ch); }
+#else
+// Output is collected in a buffer which is written to the host stderr
+// when a line is complete, when the buffer is full, on every device
+// update while the guest is quiet, and at exit.
+#define OBUF_SIZE 4096
+
+static char obuf[OBUF_SIZE];
+static int obuf_len = 0;
+
+static void serial_flush() {
+  int off = 0;
+  while (off < obuf_len) {
+    ssize_t n = write(STDERR_FILENO, obuf + off, obuf_len - off);
+    if (n <= 0) break;
+    off += n;
+  }
+  obuf_len = 0;
+}
 
 static void serial_putc(char ch) {
-  MUXDEF(CONFIG_TARGET_AM, putch(ch), putc(ch, stderr));
+  obuf[obuf_len ++] = ch;
+  if (ch == '\n' || obuf_len == OBUF_SIZE) serial_flush();
+}
+#endif
+
+#if defined(CONFIG_SERIAL_INPUT_FIFO) || defined(CONFIG_SERIAL_INPUT_PTY)
+// Host input is read by a thread blocking on the FIFO or the pty, and
+// passed to the CPU thread through this single-producer/single-consumer
+// queue, so a guest polling the receive buffer never blocks NEMU.
+#define IBUF_SIZE 1024
+#define SERIAL_FIFO "/tmp/nemu.serial"
+
+static uint8_t ibuf[IBUF_SIZE];
+static atomic_uint ibuf_f = 0, ibuf_r = 0;
+
+static bool serial_rx_ready() {
+  return atomic_load_explicit(&ibuf_f, memory_order_relaxed) !=
+    atomic_load_explicit(&ibuf_r, memory_order_acquire);
+}
+
+static uint8_t serial_getc() {
+  if (!serial_rx_ready()) return 0xff;
+  unsigned f = atomic_load_explicit(&ibuf_f, memory_order_relaxed);
+  uint8_t ch = ibuf[f];
+  atomic_store_explicit(&ibuf_f, (f + 1) % IBUF_SIZE, memory_order_release);
+  return ch;
+}
+
+static void serial_enqueue(uint8_t ch) {
+  unsigned r = atomic_load_explicit(&ibuf_r, memory_order_relaxed);
+  unsigned next = (r + 1) % IBUF_SIZE;
+  // wait for the guest to consume the input rather than dropping it
+  while (next == atomic_load_explicit(&ibuf_f, memory_order_acquire)) usleep(1000);
+  ibuf[r] = ch;
+  atomic_store_explicit(&ibuf_r, next, memory_order_release);
+}
+
+#ifdef CONFIG_SERIAL_INPUT_PTY
+static int pty_fd = -1;
+#endif
+
+static int open_input() {
+  // opening a FIFO blocks until a writer opens it
+  return MUXDEF(CONFIG_SERIAL_INPUT_FIFO, open(SERIAL_FIFO, O_RDONLY), pty_fd);
+}
+
+static void *serial_reader(void *arg) {
+  int fd = open_input();
+  uint8_t buf[256];
+  while (true) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n > 0) {
+      for (int i = 0; i < n; i ++) serial_enqueue(buf[i]);
+      continue;
+    }
+#ifdef CONFIG_SERIAL_INPUT_FIFO
+    // all writers are gone, wait for the next one
+    close(fd);
+    fd = open_input();
+#else
+    // nobody has opened the other side of the pty yet
+    usleep(10000);
+#endif
+  }
+  return NULL;
 }
 
+static void init_input() {
+#ifdef CONFIG_SERIAL_INPUT_FIFO
+  struct stat st;
+  if (stat(SERIAL_FIFO, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+    unlink(SERIAL_FIFO);
+    int ret = mkfifo(SERIAL_FIFO, 0666);
+    Assert(ret == 0, "Can not create %s", SERIAL_FIFO);
+  }
+  Log("Serial input from %s", SERIAL_FIFO);
+#else
+  pty_fd = posix_openpt(O_RDWR | O_NOCTTY);
+  bool ok = pty_fd >= 0 && grantpt(pty_fd) == 0 && unlockpt(pty_fd) == 0;
+  Assert(ok, "Can not create pty for serial");
+  Log("Serial input from %s", ptsname(pty_fd));
+#endif
+  pthread_t tid;
+  int ret = pthread_create(&tid, NULL, serial_reader, NULL);
+  assert(ret == 0);
+  pthread_detach(tid);
+}
+
+int serial_input(uint8_t *buf, int len) {
+  int n = 0;
+  while (n < len && serial_rx_ready()) buf[n ++] = serial_getc();
+  return n;
+}
+#else
+static bool serial_rx_ready() { return false; }
+static uint8_t serial_getc() { panic("do not support read"); }
+int serial_input(uint8_t *buf, int len) { return 0; }
+#endif
+
 static void serial_io_handler(uint32_t offset, int len, bool is_write) {
   assert(len == 1);
   switch (offset) {
     /* We bind the serial port with the host stderr in NEMU. */
     case CH_OFFSET:
       if (is_write) serial_putc(serial_base[0]);
-      else panic("do not support read");
+      else serial_base[0] = serial_getc();
+      break;
+    case LSR_OFFSET:
+      if (!is_write) serial_base[5] = LSR_THRE | LSR_TEMT | (serial_rx_ready() ? LSR_DR : 0);
       break;
     default: panic("do not support offset = %d", offset);
   }
 }
 
+void serial_update() {
+  IFNDEF(CONFIG_TARGET_AM, if (obuf_len > 0) serial_flush());
+}
+
 void init_serial() {
   serial_base = new_space(8);
 #ifdef CONFIG_HAS_PORT_IO
@@ -48,4 +184,8 @@ void init_serial() {
   add_mmio_map("serial", CONFIG_SERIAL_MMIO, serial_base, 8, serial_io_handler);
 #endif
 
+  IFNDEF(CONFIG_TARGET_AM, atexit(serial_flush));
+#if defined(CONFIG_SERIAL_INPUT_FIFO) || defined(CONFIG_SERIAL_INPUT_PTY)
+  init_input();
+#endif
 }
@@ -15,14 +15,35 @@
 
 #include <device/map.h>
 #include <device/alarm.h>
+#include <device/event.h>
 #include <utils.h>
 
 static uint32_t *rtc_port_base = NULL;
 
+#ifdef CONFIG_ICOUNT_IDLE_SKIP
+// The guest is considered idle when it keeps reading the timer with only
+// a few instructions in between, e.g. in a busy-waiting loop.
+#define IDLE_WINDOW 64
+#define IDLE_THRESHOLD 16
+
+static void detect_idle() {
+  extern uint64_t g_nr_guest_inst;
+  static uint64_t last = 0;
+  static int nr_spin = 0;
+  nr_spin = (g_nr_guest_inst - last < IDLE_WINDOW ? nr_spin + 1 : 0);
+  last = g_nr_guest_inst;
+  if (nr_spin >= IDLE_THRESHOLD) {
+    event_idle();
+    nr_spin = 0;
+  }
+}
+#endif
+
 static void rtc_io_handler(uint32_t offset, int len, bool is_write) {
   assert(offset == 0 || offset == 4);
   if (!is_write && offset == 4) {
-    uint64_t us = get_time();
+    IFDEF(CONFIG_ICOUNT_IDLE_SKIP, detect_idle());
+    uint64_t us = event_time_us();
     rtc_port_base[0] = (uint32_t)us;
     rtc_port_base[1] = us >> 32;
   }
@@ -44,5 +65,12 @@ void init_timer() {
 #else
   add_mmio_map("rtc", CONFIG_RTC_MMIO, rtc_port_base, 8, rtc_io_handler);
 #endif
-  IFNDEF(CONFIG_TARGET_AM, add_alarm_handle(timer_intr));
+#ifndef CONFIG_TARGET_AM
+  // the host clock drives the timer interrupt unless guest time is virtual
+#ifdef CONFIG_ICOUNT
+  event_add("timer", 1000000 / TIMER_HZ, timer_intr);
+#else
+  add_alarm_handle(timer_intr);
+#endif
+#endif
 }
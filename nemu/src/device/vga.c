@@ -56,24 +56,137 @@ static void init_screen() {
   SDL_RenderPresent(renderer);
 }
 
-static inline void update_screen() {
-  SDL_UpdateTexture(texture, NULL, vmem, SCREEN_W * sizeof(uint32_t));
+static inline void update_screen(void *pixels) {
+  SDL_UpdateTexture(texture, NULL, pixels, SCREEN_W * sizeof(uint32_t));
   SDL_RenderClear(renderer);
   SDL_RenderCopy(renderer, texture, NULL, NULL);
   SDL_RenderPresent(renderer);
 }
+
+#ifdef CONFIG_VGA_RENDER_THREAD
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Triple buffering between the CPU thread and the render thread.
+// The CPU thread owns `frame_back`, the render thread owns `frame_front`,
+// and they swap their buffer with `frame_mid` to hand over a frame.
+// FRAME_NEW in `frame_mid` means the frame there is not presented yet.
+#define FRAME_NEW 0x4
+
+static uint32_t frame_buf[3][SCREEN_W * SCREEN_H];
+static int frame_back = 0;
+static int frame_front = 1;
+static atomic_int frame_mid = 2;
+
+static void publish_frame() {
+  memcpy(frame_buf[frame_back], vmem, screen_size());
+  int old = atomic_exchange_explicit(&frame_mid, frame_back | FRAME_NEW, memory_order_acq_rel);
+  frame_back = old & ~FRAME_NEW;
+}
+
+static bool fetch_frame() {
+  if (!(atomic_load_explicit(&frame_mid, memory_order_relaxed) & FRAME_NEW)) return false;
+  int old = atomic_exchange_explicit(&frame_mid, frame_front, memory_order_acq_rel);
+  frame_front = old & ~FRAME_NEW;
+  return true;
+}
+
+static void *render_thread(void *arg) {
+  void sdl_poll_events();
+
+  // the window and the event queue belong to the thread creating them
+  init_screen();
+  while (true) {
+    sdl_poll_events();
+    if (fetch_frame()) update_screen(frame_buf[frame_front]);
+    else SDL_Delay(1);
+  }
+  return NULL;
+}
+
+static void init_render_thread() {
+  pthread_t tid;
+  int ret = pthread_create(&tid, NULL, render_thread, NULL);
+  Assert(ret == 0, "Can not create render thread");
+  pthread_detach(tid);
+}
+#endif
 #else
 static void init_screen() {}
 
-static inline void update_screen() {
-  io_write(AM_GPU_FBDRAW, 0, 0, vmem, screen_width(), screen_height(), true);
+static inline void update_screen(void *pixels) {
+  io_write(AM_GPU_FBDRAW, 0, 0, pixels, screen_width(), screen_height(), true);
 }
 #endif
 #endif
 
+#ifdef CONFIG_VGA_CAPTURE
+#include <device/alarm.h>
+#include <device/vgacap.h>
+
+static FILE *cap_fp = NULL;
+static uint32_t cap_tick = 0;
+static uint64_t cap_row_hash[SCREEN_H] = {};
+static bool cap_first = true;
+
+static uint64_t row_hash(const uint32_t *row) {
+  // FNV-1a over two pixels at a time
+  const uint64_t *p = (const uint64_t *)row;
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (int i = 0; i < SCREEN_W / 2; i ++) {
+    h = (h ^ p[i]) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+static void init_capture() {
+  const char *path = CONFIG_VGA_CAPTURE_PATH;
+  cap_fp = fopen(path, "w");
+  Assert(cap_fp, "Can not open '%s'", path);
+  setvbuf(cap_fp, NULL, _IOFBF, SCREEN_W * SCREEN_H * sizeof(uint32_t));
+  memset(vmem, 0, screen_size());
+
+  VGACapHeader h = { .width = SCREEN_W, .height = SCREEN_H, .hz = TIMER_HZ };
+  memcpy(h.magic, VGACAP_MAGIC, sizeof(h.magic));
+  fwrite(&h, sizeof(h), 1, cap_fp);
+  fflush(cap_fp);
+  Log("VGA frames are captured to %s", path);
+}
+
+static void capture_screen() {
+  static VGACapSpan span[SCREEN_H];
+  const uint32_t *fb = vmem;
+  int nr_span = 0;
+  bool in_span = false;
+  for (int y = 0; y < SCREEN_H; y ++) {
+    uint64_t h = row_hash(fb + y * SCREEN_W);
+    bool changed = cap_first || h != cap_row_hash[y];
+    cap_row_hash[y] = h;
+    if (changed && in_span) span[nr_span - 1].nr_row ++;
+    else if (changed) span[nr_span ++] = (VGACapSpan) { .first_row = y, .nr_row = 1 };
+    in_span = changed;
+  }
+  cap_first = false;
+  if (nr_span == 0) return;
+
+  VGACapFrame f = { .tick = cap_tick, .nr_span = nr_span };
+  fwrite(&f, sizeof(f), 1, cap_fp);
+  for (int i = 0; i < nr_span; i ++) {
+    fwrite(&span[i], sizeof(span[i]), 1, cap_fp);
+    fwrite(fb + span[i].first_row * SCREEN_W, sizeof(uint32_t) * SCREEN_W, span[i].nr_row, cap_fp);
+  }
+  fflush(cap_fp);
+}
+#endif
+
 void vga_update_screen() {
-  // TODO: call `update_screen()` when the sync register is non-zero,
-  // then zero out the sync register
+  IFDEF(CONFIG_VGA_CAPTURE, cap_tick ++);
+  if (vgactl_port_base[1] == 0) return;
+#ifdef CONFIG_VGA_SHOW_SCREEN
+  MUXDEF(CONFIG_VGA_RENDER_THREAD, publish_frame(), update_screen(vmem));
+#endif
+  IFDEF(CONFIG_VGA_CAPTURE, capture_screen());
+  vgactl_port_base[1] = 0;
 }
 
 void init_vga() {
@@ -87,6 +200,7 @@ void init_vga() {
 
   vmem = new_space(screen_size());
   add_mmio_map("vmem", CONFIG_FB_ADDR, vmem, screen_size(), NULL);
-  IFDEF(CONFIG_VGA_SHOW_SCREEN, init_screen());
+  IFDEF(CONFIG_VGA_SHOW_SCREEN, MUXDEF(CONFIG_VGA_RENDER_THREAD, init_render_thread(), init_screen()));
   IFDEF(CONFIG_VGA_SHOW_SCREEN, memset(vmem, 0, screen_size()));
+  IFDEF(CONFIG_VGA_CAPTURE, init_capture());
 }
@@ -0,0 +1,92 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <device/virtio.h>
+#include <device/blkimg.h>
+
+// virtio block device with a single request queue. A request is a chain
+// of a header, the data buffers and a one-byte status.
+
+#define SECTOR_SIZE 512
+
+enum { VIRTIO_BLK_T_IN = 0, VIRTIO_BLK_T_OUT = 1 };
+enum { VIRTIO_BLK_S_OK = 0, VIRTIO_BLK_S_IOERR = 1, VIRTIO_BLK_S_UNSUPP = 2 };
+
+typedef struct {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t sector;
+} BlkReqHdr;
+
+static VirtioDev blk = {};
+static BlkImg *img = NULL;
+static uint64_t capacity = 0;  // in sectors
+
+static uint8_t blk_request(BlkReqHdr *hdr, VirtqDesc **data, int nr_data, uint32_t *written) {
+  if (hdr->type != VIRTIO_BLK_T_IN && hdr->type != VIRTIO_BLK_T_OUT) return VIRTIO_BLK_S_UNSUPP;
+  bool is_write = (hdr->type == VIRTIO_BLK_T_OUT);
+  if (hdr->sector >= capacity) return VIRTIO_BLK_S_IOERR;
+  uint64_t off = hdr->sector * SECTOR_SIZE, size = capacity * SECTOR_SIZE;
+  for (int i = 0; i < nr_data; i ++) {
+    VirtqDesc *d = data[i];
+    uint8_t *buf = virtq_buf(d);
+    // off <= size holds here, so this does not overflow
+    if (buf == NULL || d->len > size - off ||
+        is_write == !!(d->flags & VIRTQ_DESC_F_WRITE)) return VIRTIO_BLK_S_IOERR;
+    if (is_write) blkimg_write(img, off, buf, d->len);
+    else {
+      blkimg_read(img, off, buf, d->len);
+      *written += d->len;
+    }
+    off += d->len;
+  }
+  return VIRTIO_BLK_S_OK;
+}
+
+static void blk_notify(VirtioDev *dev, int q) {
+  VirtqDesc *d, *data[VIRTQ_NUM_MAX];
+  int head;
+  while ((d = virtq_pop(dev, q, &head)) != NULL) {
+    BlkReqHdr *hdr = (d->len >= sizeof(BlkReqHdr) ? virtq_buf(d) : NULL);
+    int nr_data = 0;
+    for (d = virtq_next(dev, q, d); d != NULL && nr_data < VIRTQ_NUM_MAX; d = virtq_next(dev, q, d)) {
+      data[nr_data ++] = d;
+    }
+    // the last descriptor holds the status
+    uint8_t *status = (nr_data > 0 ? virtq_buf(data[-- nr_data]) : NULL);
+    uint32_t written = 0;
+    if (status != NULL) {
+      *status = (hdr && img ? blk_request(hdr, data, nr_data, &written) : VIRTIO_BLK_S_IOERR);
+      written ++;
+    }
+    virtq_push(dev, q, head, written);
+  }
+}
+
+static void blk_io_handler(uint32_t offset, int len, bool is_write) {
+  virtio_mmio_access(&blk, offset, len, is_write);
+}
+
+void init_virtio_blk() {
+  virtio_init(&blk, "virtio-blk", CONFIG_VIRTIO_BLK_MMIO, VIRTIO_ID_BLOCK, 1,
+      blk_io_handler, blk_notify);
+  const char *path = CONFIG_VIRTIO_BLK_IMG_PATH;
+  img = blkimg_open(path, MUXDEF(CONFIG_VIRTIO_BLK_IMG_OVERLAY, true, false));
+  if (img != NULL) capacity = blkimg_size(img) / SECTOR_SIZE;
+  else if (path[0] != '\0') Log("Can not find virtio-blk image: %s", path);
+  // config space: uint64_t capacity
+  memcpy(virtio_config(&blk), &capacity, sizeof(capacity));
+}
@@ -0,0 +1,91 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <device/virtio.h>
+#include <device/event.h>
+#include <device/alarm.h>
+#include <unistd.h>
+
+// virtio console with a receive queue (0) and a transmit queue (1). The
+// output of a whole batch of buffers is written to the host stderr at
+// once. Input is taken from the serial input, if there is one, and
+// delivered into the receive buffers posted by the guest.
+
+enum { CONSOLE_RX, CONSOLE_TX };
+
+static VirtioDev console = {};
+
+int serial_input(uint8_t *buf, int len);
+
+static void console_rx() {
+  // a receive buffer is held until there is input for it
+  static VirtqDesc *rx_desc = NULL;
+  static int rx_head = -1;
+  if (!console.vq[CONSOLE_RX].ready) rx_head = -1;
+  while (true) {
+    if (rx_head < 0) {
+      rx_desc = virtq_pop(&console, CONSOLE_RX, &rx_head);
+      if (rx_desc == NULL) { rx_head = -1; return; }
+    }
+    uint8_t *p = virtq_buf(rx_desc);
+    int n = 0;
+    if (p != NULL && (rx_desc->flags & VIRTQ_DESC_F_WRITE)) {
+      n = MUXDEF(CONFIG_HAS_SERIAL, serial_input(p, rx_desc->len), 0);
+      if (n == 0) return;
+    }
+    virtq_push(&console, CONSOLE_RX, rx_head, n);
+    rx_head = -1;
+  }
+}
+
+static void console_tx() {
+  static char obuf[4096];
+  int len = 0;
+  VirtqDesc *d;
+  int head;
+  while ((d = virtq_pop(&console, CONSOLE_TX, &head)) != NULL) {
+    // a cyclic chain is cut after as many descriptors as the queue has
+    for (int i = 0; d != NULL && i < console.vq[CONSOLE_TX].num;
+        d = virtq_next(&console, CONSOLE_TX, d), i ++) {
+      char *p = virtq_buf(d);
+      if (p == NULL || (d->flags & VIRTQ_DESC_F_WRITE)) continue;
+      for (uint32_t i = 0; i < d->len; i ++) {
+        if (len == sizeof(obuf)) {
+          if (write(STDERR_FILENO, obuf, len) < 0) break;
+          len = 0;
+        }
+        obuf[len ++] = p[i];
+      }
+    }
+    virtq_push(&console, CONSOLE_TX, head, 0);
+  }
+  if (len > 0 && write(STDERR_FILENO, obuf, len) < 0) return;
+}
+
+static void console_notify(VirtioDev *dev, int q) {
+  if (q == CONSOLE_TX) console_tx();
+  else console_rx();
+}
+
+static void console_io_handler(uint32_t offset, int len, bool is_write) {
+  virtio_mmio_access(&console, offset, len, is_write);
+}
+
+void init_virtio_console() {
+  virtio_init(&console, "virtio-console", CONFIG_VIRTIO_CONSOLE_MMIO, VIRTIO_ID_CONSOLE, 2,
+      console_io_handler, console_notify);
+  event_add("virtio-console", 1000000 / TIMER_HZ, console_rx);
+}
@@ -0,0 +1,188 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <device/virtio.h>
+#include <memory/paddr.h>
+
+// Register offsets of virtio-mmio
+enum {
+  VIRTIO_MAGIC            = 0x000,
+  VIRTIO_VERSION          = 0x004,
+  VIRTIO_DEVICE_ID        = 0x008,
+  VIRTIO_VENDOR_ID        = 0x00c,
+  VIRTIO_DEVICE_FEATURES  = 0x010,
+  VIRTIO_DEVICE_FEATURES_SEL = 0x014,
+  VIRTIO_DRIVER_FEATURES  = 0x020,
+  VIRTIO_DRIVER_FEATURES_SEL = 0x024,
+  VIRTIO_QUEUE_SEL        = 0x030,
+  VIRTIO_QUEUE_NUM_MAX    = 0x034,
+  VIRTIO_QUEUE_NUM        = 0x038,
+  VIRTIO_QUEUE_READY      = 0x044,
+  VIRTIO_QUEUE_NOTIFY     = 0x050,
+  VIRTIO_INTERRUPT_STATUS = 0x060,
+  VIRTIO_INTERRUPT_ACK    = 0x064,
+  VIRTIO_STATUS           = 0x070,
+  VIRTIO_QUEUE_DESC_LOW   = 0x080,
+  VIRTIO_QUEUE_DESC_HIGH  = 0x084,
+  VIRTIO_QUEUE_AVAIL_LOW  = 0x090,
+  VIRTIO_QUEUE_AVAIL_HIGH = 0x094,
+  VIRTIO_QUEUE_USED_LOW   = 0x0a0,
+  VIRTIO_QUEUE_USED_HIGH  = 0x0a4,
+  VIRTIO_CONFIG_GENERATION = 0x0fc,
+  VIRTIO_CONFIG           = 0x100,
+};
+
+#define VIRTIO_MAGIC_VALUE 0x74726976  // "virt"
+#define VIRTIO_VENDOR_NEMU 0x554d454e  // "NEMU"
+#define VIRTIO_F_VERSION_1 1           // bit 32, in the second feature word
+
+#define REG(off) (dev->regs[(off) / 4])
+
+static void *guest_ptr(paddr_t addr, uint32_t len) {
+  paddr_t end = addr + len - 1;
+  if (len == 0 || !in_pmem(addr) || !in_pmem(end) || end < addr) return NULL;
+  return guest_to_host(addr);
+}
+
+static void sync_to_ref(paddr_t addr, uint32_t len) {
+  IFDEF(CONFIG_DIFFTEST, ref_difftest_memcpy(addr, guest_to_host(addr), len, DIFFTEST_TO_REF));
+}
+
+static void virtio_reset(VirtioDev *dev) {
+  memset(dev->vq, 0, sizeof(dev->vq));
+  REG(VIRTIO_STATUS) = 0;
+  REG(VIRTIO_INTERRUPT_STATUS) = 0;
+  REG(VIRTIO_QUEUE_SEL) = 0;
+}
+
+static Virtq *selected_queue(VirtioDev *dev) {
+  uint32_t q = REG(VIRTIO_QUEUE_SEL);
+  return (q < dev->nr_queue ? &dev->vq[q] : NULL);
+}
+
+void virtio_mmio_access(VirtioDev *dev, uint32_t offset, int len, bool is_write) {
+  if (offset >= VIRTIO_CONFIG) return;
+  assert(len == 4 && offset % 4 == 0);
+  Virtq *vq = selected_queue(dev);
+  if (!is_write) {
+    switch (offset) {
+      case VIRTIO_DEVICE_FEATURES:
+        REG(offset) = (REG(VIRTIO_DEVICE_FEATURES_SEL) == 1 ? VIRTIO_F_VERSION_1 : 0);
+        break;
+      case VIRTIO_QUEUE_NUM_MAX: REG(offset) = (vq ? VIRTQ_NUM_MAX : 0); break;
+      case VIRTIO_QUEUE_NUM:     REG(offset) = (vq ? vq->num : 0); break;
+      case VIRTIO_QUEUE_READY:   REG(offset) = (vq ? vq->ready : 0); break;
+    }
+    return;
+  }
+
+  uint32_t val = REG(offset);
+  switch (offset) {
+    case VIRTIO_QUEUE_NUM:
+      if (vq) vq->num = (val <= VIRTQ_NUM_MAX ? val : VIRTQ_NUM_MAX);
+      break;
+    case VIRTIO_QUEUE_DESC_LOW:  if (vq) vq->desc = val; break;
+    case VIRTIO_QUEUE_AVAIL_LOW: if (vq) vq->avail = val; break;
+    case VIRTIO_QUEUE_USED_LOW:  if (vq) vq->used = val; break;
+    case VIRTIO_QUEUE_READY:
+      // a queue without a size can not be used
+      if (vq) {
+        vq->ready = (val & 1) && vq->num > 0;
+        vq->last_avail = 0;
+      }
+      break;
+    case VIRTIO_QUEUE_NOTIFY:
+      if (val < dev->nr_queue && dev->vq[val].ready) dev->notify(dev, val);
+      break;
+    case VIRTIO_INTERRUPT_ACK: REG(VIRTIO_INTERRUPT_STATUS) &= ~val; break;
+    case VIRTIO_STATUS: if (val == 0) virtio_reset(dev); break;
+    default: break;
+  }
+}
+
+void *virtio_config(VirtioDev *dev) {
+  return &REG(VIRTIO_CONFIG);
+}
+
+void virtio_init(VirtioDev *dev, const char *name, paddr_t addr,
+    uint32_t device_id, int nr_queue, io_callback_t handler, virtio_notify_t notify) {
+  assert(nr_queue <= VIRTIO_MAX_QUEUE);
+  dev->regs = (uint32_t *)new_space(VIRTIO_MMIO_SIZE);
+  dev->device_id = device_id;
+  dev->nr_queue = nr_queue;
+  dev->notify = notify;
+  add_mmio_map(name, addr, dev->regs, VIRTIO_MMIO_SIZE, handler);
+
+  REG(VIRTIO_MAGIC) = VIRTIO_MAGIC_VALUE;
+  REG(VIRTIO_VERSION) = 2;
+  REG(VIRTIO_DEVICE_ID) = device_id;
+  REG(VIRTIO_VENDOR_ID) = VIRTIO_VENDOR_NEMU;
+  virtio_reset(dev);
+}
+
+// The rings are located in guest memory:
+//   avail: uint16_t flags, idx, ring[num]
+//   used:  uint16_t flags, idx, struct { uint32_t id, len; } ring[num]
+
+bool virtq_has_avail(VirtioDev *dev, int q) {
+  Virtq *vq = &dev->vq[q];
+  if (!vq->ready || vq->num == 0) return false;
+  uint16_t *avail = guest_ptr(vq->avail, 4 + 2 * vq->num);
+  return avail != NULL && avail[1] != vq->last_avail;
+}
+
+VirtqDesc *virtq_pop(VirtioDev *dev, int q, int *head) {
+  Virtq *vq = &dev->vq[q];
+  while (virtq_has_avail(dev, q)) {
+    uint16_t *avail = (uint16_t *)guest_to_host(vq->avail);
+    *head = avail[2 + vq->last_avail % vq->num];
+    vq->last_avail ++;
+    VirtqDesc *desc = guest_ptr(vq->desc, sizeof(VirtqDesc) * vq->num);
+    if (desc != NULL && *head < vq->num) return &desc[*head];
+    // return a bad request unprocessed, so the driver does not wait for it
+    virtq_push(dev, q, *head, 0);
+  }
+  return NULL;
+}
+
+VirtqDesc *virtq_next(VirtioDev *dev, int q, VirtqDesc *d) {
+  Virtq *vq = &dev->vq[q];
+  if (!(d->flags & VIRTQ_DESC_F_NEXT) || d->next >= vq->num) return NULL;
+  return (VirtqDesc *)guest_to_host(vq->desc) + d->next;
+}
+
+void *virtq_buf(VirtqDesc *d) {
+  return guest_ptr(d->addr, d->len);
+}
+
+void virtq_push(VirtioDev *dev, int q, int head, uint32_t len) {
+  Virtq *vq = &dev->vq[q];
+  uint16_t *used = guest_ptr(vq->used, 4 + 8 * vq->num);
+  if (used == NULL) return;
+#ifdef CONFIG_DIFFTEST
+  VirtqDesc *desc = guest_ptr(vq->desc, sizeof(VirtqDesc) * vq->num);
+  VirtqDesc *d = (desc != NULL && head < vq->num ? &desc[head] : NULL);
+  for (int i = 0; d != NULL && i < vq->num; d = virtq_next(dev, q, d), i ++) {
+    if ((d->flags & VIRTQ_DESC_F_WRITE) && virtq_buf(d)) sync_to_ref(d->addr, d->len);
+  }
+#endif
+  uint32_t *elem = (uint32_t *)(used + 2) + 2 * (used[1] % vq->num);
+  elem[0] = head;
+  elem[1] = len;
+  used[1] ++;
+  sync_to_ref(vq->used, 4 + 8 * vq->num);
+  REG(VIRTIO_INTERRUPT_STATUS) |= 1;
+}
@@ -17,6 +17,27 @@ SRCS-y += src/nemu-main.c
 DIRS-y += src/cpu src/monitor src/utils
 DIRS-$(CONFIG_MODE_SYSTEM) += src/memory
 DIRS-BLACKLIST-$(CONFIG_TARGET_AM) += src/monitor/sdb
+ifndef CONFIG_ITRACE_BINARY
+SRCS-BLACKLIST-y += src/utils/itrace-bin.c
+endif
+ifndef CONFIG_MITRACE
+SRCS-BLACKLIST-y += src/utils/mtrace.c
+endif
+ifeq ($(CONFIG_ITRACE_BINARY)$(CONFIG_MITRACE),)
+SRCS-BLACKLIST-y += src/utils/trace-file.c
+endif
+ifndef CONFIG_CACHESIM
+SRCS-BLACKLIST-y += src/memory/cachesim.c
+endif
+ifndef CONFIG_BPRED
+SRCS-BLACKLIST-y += src/cpu/bpred.c
+endif
+ifndef CONFIG_PLUGIN
+SRCS-BLACKLIST-y += src/cpu/plugin.c
+endif
+ifndef CONFIG_PROFILER
+SRCS-BLACKLIST-y += src/utils/profile.c
+endif
 
 SHARE = $(if $(CONFIG_TARGET_SHARE),1,0)
 LIBS += $(if $(CONFIG_TARGET_NATIVE_ELF),-lreadline -ldl -pie,)
@@ -21,6 +21,11 @@
 typedef struct {
   word_t gpr[MUXDEF(CONFIG_RVE, 16, 32)];
   vaddr_t pc;
+  word_t mstatus, mtvec, mepc, mcause, mscratch, mie, mip;
+  // mip & mie, or 0 when mstatus.MIE is clear. It is kept up to date by
+  // every write to the three CSRs, so the CPU only tests this word after
+  // each instruction.
+  word_t intr;
 } MUXDEF(CONFIG_RV64, riscv64_CPU_state, riscv32_CPU_state);
 
 // decode
@@ -31,5 +36,9 @@ typedef struct {
 } MUXDEF(CONFIG_RV64, riscv64_ISADecodeInfo, riscv32_ISADecodeInfo);
 
 #define isa_mmu_check(vaddr, len, type) (MMU_DIRECT)
+#define isa_has_intr() (cpu.intr != 0)
+// the destination register after `s' is executed, for the binary
+// instruction trace; rd is masked to stay within the RVE registers
+#define isa_inst_rd_val(s) (cpu.gpr[BITS((s)->isa.inst.val, 11, 7) & (ARRLEN(cpu.gpr) - 1)])
 
 #endif
@@ -14,9 +14,12 @@
  ***************************************************************************************/
 
 #include "local-include/reg.h"
+#include "local-include/csr.h"
+#include <cpu/bpred.h>
 #include <cpu/cpu.h>
 #include <cpu/decode.h>
 #include <cpu/ifetch.h>
+#include <cpu/perf.h>
 #include <stdint.h>
 #include <utils.h>
 // #include <stdio.h>
@@ -24,6 +27,16 @@
 #define R(i) gpr(i)
 #define Mr vaddr_read
 #define Mw vaddr_write
+#define CSR BITS(s->isa.inst.val, 31, 20)
+#define ZIMM BITS(s->isa.inst.val, 19, 15)
+#define branch(cond) do { \
+  bool taken = (cond); \
+  if (taken) { s->dnpc = s->pc + imm; perf_count(branch); } \
+  bpred_branch(s->pc, taken, s->pc + imm); \
+} while (0)
+// x1 and x5 are the link registers, as hinted by the RISC-V spec
+#define is_link(r) ((r) == 1 || (r) == 5)
+#define jump(kind) bpred_jump(s->pc, s->dnpc, kind)
 
 enum {
   TYPE_I,
@@ -111,14 +124,16 @@ static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2,
     break;
   }
 }
+// function calls are tracked for ftrace and for the profiler's call stacks
+#if defined(CONFIG_ITRACE) || defined(CONFIG_PROFILER_CALL_STACK)
 #define MAYBE_FUNC_JAL(s)                                                      \
-  IFDEF(CONFIG_ITRACE, {                                                       \
+  do {                                                                         \
     if (rd == 1) {                                                             \
       trace_func_call(s->pc, s->dnpc, false);                                  \
     }                                                                          \
-  })
+  } while (0)
 #define MAYBE_FUNC_JALR(s)                                                     \
-  IFDEF(CONFIG_ITRACE, {                                                       \
+  do {                                                                         \
     if (s->isa.inst.val == 0x00008067) {                                       \
       trace_func_ret(s->pc);                                                   \
     } else if (rd == 1) {                                                      \
@@ -126,7 +141,11 @@ static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2,
     } else if (rd == 0 && imm == 0) {                                          \
       trace_func_call(s->pc, s->dnpc, true);                                   \
     }                                                                          \
-  })
+  } while (0)
+#else
+#define MAYBE_FUNC_JAL(s)
+#define MAYBE_FUNC_JALR(s)
+#endif
 
 static int decode_exec(Decode *s) {
   int rd = 0;
@@ -171,11 +190,14 @@ static int decode_exec(Decode *s) {
   // ret : jalr x0,0(x1)
   INSTPAT("??????? ????? ????? ??? ????? 11011 11", jal, J,
           s->dnpc = s->pc + imm;
-          MAYBE_FUNC_JAL(s); 
+          MAYBE_FUNC_JAL(s);
+          jump(is_link(rd) ? BP_CALL : 0);
           R(rd) = s->pc + 4);
   INSTPAT("??????? ????? ????? 000 ????? 11001 11", jalr, I,
           s->dnpc = (src1 + imm) & ~(word_t)1;
           MAYBE_FUNC_JALR(s);
+          jump(BP_INDIRECT | (is_link(rd) ? BP_CALL :
+              (is_link(BITS(s->isa.inst.val, 19, 15)) ? BP_RET : 0)));
           R(rd) = s->pc + 4);
   // INSTPAT("??????? ????? ????? ??? ????? 1101111", jal, J,
   //         s->dnpc = s->pc + imm;
@@ -242,17 +264,17 @@ static int decode_exec(Decode *s) {
           R(rd) = src1 >> shamt);
 
   INSTPAT("??????? ????? ????? 000 ????? 1100011", beq, B,
-          if (src1 == src2) s->dnpc = s->pc + imm);
+          branch(src1 == src2));
   INSTPAT("??????? ????? ????? 001 ????? 1100011", bne, B,
-          if (src1 != src2) s->dnpc = s->pc + imm);
+          branch(src1 != src2));
   INSTPAT("??????? ????? ????? 101 ????? 1100011", bge, B,
-          if ((int32_t)src1 >= (int32_t)src2) s->dnpc = s->pc + imm);
+          branch((int32_t)src1 >= (int32_t)src2));
   INSTPAT("??????? ????? ????? 100 ????? 1100011", blt, B,
-          if ((int32_t)src1 < (int32_t)src2) s->dnpc = s->pc + imm);
+          branch((int32_t)src1 < (int32_t)src2));
   INSTPAT("??????? ????? ????? 110 ????? 1100011", bltu, B,
-          if ((uint32_t)src1 < (uint32_t)src2) s->dnpc = s->pc + imm);
+          branch((uint32_t)src1 < (uint32_t)src2));
   INSTPAT("??????? ????? ????? 111 ????? 1100011", bgeu, B,
-          if ((uint32_t)src1 >= (uint32_t)src2) s->dnpc = s->pc + imm);
+          branch((uint32_t)src1 >= (uint32_t)src2));
 
   INSTPAT("??????? ????? ????? ??? ????? 0110111", lui, U, R(rd) = imm);
 
@@ -265,6 +287,22 @@ static int decode_exec(Decode *s) {
           Mw(src1 + imm, 1, src2));
   INSTPAT("0000000 00001 00000 000 00000 11100 11", ebreak, N,
           NEMUTRAP(s->pc, R(10))); // R(10) is $a0
+  INSTPAT("0000000 00000 00000 000 00000 11100 11", ecall, N,
+          s->dnpc = isa_raise_intr(EXCP_ECALL_M, s->pc));
+  INSTPAT("0011000 00010 00000 000 00000 11100 11", mret, N,
+          s->dnpc = isa_mret());
+  INSTPAT("??????? ????? ????? 001 ????? 11100 11", csrrw, I,
+          word_t t = csr_read(CSR); csr_write(CSR, src1); R(rd) = t);
+  INSTPAT("??????? ????? ????? 010 ????? 11100 11", csrrs, I,
+          word_t t = csr_read(CSR); if (ZIMM) csr_write(CSR, t | src1); R(rd) = t);
+  INSTPAT("??????? ????? ????? 011 ????? 11100 11", csrrc, I,
+          word_t t = csr_read(CSR); if (ZIMM) csr_write(CSR, t & ~src1); R(rd) = t);
+  INSTPAT("??????? ????? ????? 101 ????? 11100 11", csrrwi, I,
+          word_t t = csr_read(CSR); csr_write(CSR, ZIMM); R(rd) = t);
+  INSTPAT("??????? ????? ????? 110 ????? 11100 11", csrrsi, I,
+          word_t t = csr_read(CSR); if (ZIMM) csr_write(CSR, t | ZIMM); R(rd) = t);
+  INSTPAT("??????? ????? ????? 111 ????? 11100 11", csrrci, I,
+          word_t t = csr_read(CSR); if (ZIMM) csr_write(CSR, t & ~ZIMM); R(rd) = t);
   INSTPAT("??????? ????? ????? ??? ????? ????? ??", inv, N, INV(s->pc));
   INSTPAT_END();
 
@@ -0,0 +1,50 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __RISCV_CSR_H__
+#define __RISCV_CSR_H__
+
+#include <common.h>
+
+enum {
+  CSR_MSTATUS  = 0x300,
+  CSR_MIE      = 0x304,
+  CSR_MTVEC    = 0x305,
+  CSR_MSCRATCH = 0x340,
+  CSR_MEPC     = 0x341,
+  CSR_MCAUSE   = 0x342,
+  CSR_MIP      = 0x344,
+  CSR_MCYCLE   = 0xb00,
+  CSR_CYCLE    = 0xc00,
+  CSR_MHARTID  = 0xf14,
+};
+
+#define MSTATUS_MIE  (1 << 3)
+#define MSTATUS_MPIE (1 << 7)
+#define MSTATUS_MPP  (3 << 11)
+
+#define IRQ_MTI 7
+#define MIP_MTIP (1 << IRQ_MTI)
+#define INTR_BIT ((word_t)1 << (sizeof(word_t) * 8 - 1))
+
+#define EXCP_ECALL_M 11
+
+word_t csr_read(uint32_t addr);
+void csr_write(uint32_t addr, word_t val);
+void update_intr();
+vaddr_t isa_mret();
+
+#endif
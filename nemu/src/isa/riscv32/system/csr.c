@@ -0,0 +1,78 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/difftest.h>
+#include <cpu/perf.h>
+#include "../local-include/csr.h"
+
+// mcycle, minstret and mhpmcounter3-31 live at 0xb00-0xb1f, their high
+// halves at 0xb80-0xb9f, and the read-only user mirrors at 0xc00/0xc80.
+// One instruction takes one cycle, and writes to the counters are ignored.
+static bool is_counter(uint32_t addr) {
+  uint32_t base = addr & ~0x9f;
+  return base == CSR_MCYCLE || base == CSR_CYCLE;
+}
+
+static uint64_t counter_read(uint32_t idx) {
+  switch (idx) {
+    case 0: case 2: return g_nr_guest_inst;  // cycle, instret
+    case 3: return g_perf.load;
+    case 4: return g_perf.store;
+    case 5: return g_perf.branch;
+    case 6: return g_perf.mmio;
+    default: return 0;
+  }
+}
+
+static word_t *csr_reg(uint32_t addr) {
+  static word_t scratch = 0;
+  switch (addr) {
+    case CSR_MSTATUS:  return &cpu.mstatus;
+    case CSR_MIE:      return &cpu.mie;
+    case CSR_MTVEC:    return &cpu.mtvec;
+    case CSR_MSCRATCH: return &cpu.mscratch;
+    case CSR_MEPC:     return &cpu.mepc;
+    case CSR_MCAUSE:   return &cpu.mcause;
+    case CSR_MIP:      return &cpu.mip;
+    default:
+      // an unimplemented CSR makes the instruction invalid, which is
+      // reported once even if the instruction both reads and writes it
+      if (nemu_state.state == NEMU_RUNNING) {
+        Log("unsupported CSR 0x%03x at pc = " FMT_WORD, addr, cpu.pc);
+        INV(cpu.pc);
+      }
+      return &scratch;
+  }
+}
+
+word_t csr_read(uint32_t addr) {
+  if (addr == CSR_MHARTID) return 0;
+  if (is_counter(addr)) {
+    // the REF counts differently, so do not compare the result
+    difftest_skip_ref();
+    uint64_t val = counter_read(addr & 0x1f);
+    return (addr & 0x80 ? val >> 32 : val);
+  }
+  return *csr_reg(addr);
+}
+
+void csr_write(uint32_t addr, word_t val) {
+  if (addr == CSR_MHARTID || is_counter(addr)) return;
+  *csr_reg(addr) = val;
+  if (addr == CSR_MSTATUS || addr == CSR_MIE || addr == CSR_MIP) update_intr();
+}
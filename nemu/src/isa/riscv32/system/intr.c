@@ -14,15 +14,44 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <cpu/difftest.h>
+#include <cpu/plugin.h>
+#include "../local-include/csr.h"
+
+void update_intr() {
+  cpu.intr = cpu.mip & cpu.mie & ((cpu.mstatus & MSTATUS_MIE) ? (word_t)-1 : 0);
+}
 
 word_t isa_raise_intr(word_t NO, vaddr_t epc) {
-  /* TODO: Trigger an interrupt/exception with ``NO''.
-   * Then return the address of the interrupt/exception vector.
-   */
+  cpu.mepc = epc;
+  cpu.mcause = NO;
+  word_t mpie = (cpu.mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0;
+  cpu.mstatus = (cpu.mstatus & ~(MSTATUS_MIE | MSTATUS_MPIE)) | mpie | MSTATUS_MPP;
+  update_intr();
+  IFDEF(CONFIG_PLUGIN, if (plugin_on(PLUGIN_TRAP)) plugin_trap(epc, NO, cpu.mtvec));
+  return cpu.mtvec;
+}
 
-  return 0;
+vaddr_t isa_mret() {
+  word_t mie = (cpu.mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0;
+  cpu.mstatus = (cpu.mstatus & ~MSTATUS_MIE) | mie | MSTATUS_MPIE | MSTATUS_MPP;
+  update_intr();
+  return cpu.mepc;
 }
 
 word_t isa_query_intr() {
+  if (cpu.intr & MIP_MTIP) {
+    // there is no mtimecmp to clear the pending bit, so the timer
+    // interrupt is taken as an edge
+    cpu.mip &= ~MIP_MTIP;
+    update_intr();
+    return INTR_BIT | IRQ_MTI;
+  }
   return INTR_EMPTY;
 }
+
+void isa_dev_intr() {
+  // the timer is the only device raising interrupts
+  cpu.mip |= MIP_MTIP;
+  update_intr();
+}
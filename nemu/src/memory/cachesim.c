@@ -0,0 +1,287 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <utils.h>
+#include <memory/cachesim.h>
+
+// L1I and L1D caches backed by a unified L2. Only tags are simulated, the
+// data always comes from the memory. Each cache remembers the line of its
+// last access, so a run of accesses to the same line skips the lookup.
+//
+// Misses are also counted per pc of the instruction which caused them.
+// Accesses are not, to keep the hit path cheap, so the per-pc and
+// per-function reports show miss counts instead of rates.
+
+#define LINE_SIZE CONFIG_CACHESIM_LINE_SIZE
+#define LINE_SHIFT (__builtin_ctz(LINE_SIZE))
+#define INVALID_TAG ((uint64_t)-1)
+
+#if (LINE_SIZE & (LINE_SIZE - 1)) != 0
+#error "the line size of the cache simulator must be a power of 2"
+#endif
+
+enum { L1I, L1D, L2, NR_CACHE };
+
+typedef struct {
+  uint64_t tag;   // line address, INVALID_TAG for an empty way
+  uint64_t stamp; // time of the last use, for LRU
+  bool dirty;
+} CacheLine;
+
+typedef struct Cache {
+  const char *name;
+  int nr_set, nr_way;
+  CacheLine *line;    // nr_set * nr_way
+  uint64_t *plru;     // tree bits of each set, for PLRU
+  uint64_t clock;
+  struct Cache *next; // NULL for the memory
+  uint64_t last_tag;  // the line of the last access
+  CacheLine *last;
+  uint64_t access, miss, writeback;
+} Cache;
+
+typedef struct {
+  vaddr_t pc;
+  uint64_t miss[NR_CACHE];
+} PCStat;
+
+static Cache cache[NR_CACHE];
+static uint64_t mem_read = 0, mem_write = 0;
+
+static PCStat *pc_stat = NULL; // open addressing, pc 0 marks an empty slot
+static uint32_t pc_stat_size = 0, nr_pc_stat = 0;
+
+static PCStat *pc_stat_get(vaddr_t pc) {
+  if (nr_pc_stat * 2 >= pc_stat_size) {
+    PCStat *old = pc_stat;
+    uint32_t old_size = pc_stat_size;
+    pc_stat_size = (old_size == 0 ? 1024 : old_size * 2);
+    pc_stat = calloc(pc_stat_size, sizeof(PCStat));
+    assert(pc_stat);
+    for (uint32_t i = 0; i < old_size; i ++) {
+      if (old[i].pc == 0) continue;
+      uint32_t h = (old[i].pc * 0x9e3779b1u) & (pc_stat_size - 1);
+      while (pc_stat[h].pc != 0) h = (h + 1) & (pc_stat_size - 1);
+      pc_stat[h] = old[i];
+    }
+    free(old);
+  }
+  uint32_t h = (pc * 0x9e3779b1u) & (pc_stat_size - 1);
+  for (; pc_stat[h].pc != 0; h = (h + 1) & (pc_stat_size - 1)) {
+    if (pc_stat[h].pc == pc) return &pc_stat[h];
+  }
+  pc_stat[h].pc = pc;
+  nr_pc_stat ++;
+  return &pc_stat[h];
+}
+
+static void touch(Cache *c, int set, int way) {
+#ifdef CONFIG_CACHESIM_PLRU
+  // make every node on the path to this way point away from it
+  int node = 1;
+  for (int bit = c->nr_way >> 1; bit > 0; bit >>= 1) {
+    int right = (way & bit) != 0;
+    if (right) c->plru[set] &= ~(1ull << node);
+    else c->plru[set] |= (1ull << node);
+    node = node * 2 + right;
+  }
+#else
+  c->line[set * c->nr_way + way].stamp = ++ c->clock;
+#endif
+}
+
+static int victim(Cache *c, int set) {
+  CacheLine *l = &c->line[set * c->nr_way];
+  for (int w = 0; w < c->nr_way; w ++) {
+    if (l[w].tag == INVALID_TAG) return w;
+  }
+#ifdef CONFIG_CACHESIM_PLRU
+  int node = 1;
+  while (node < c->nr_way) node = node * 2 + ((c->plru[set] >> node) & 1);
+  return node - c->nr_way;
+#else
+  int v = 0;
+  for (int w = 1; w < c->nr_way; w ++) {
+    if (l[w].stamp < l[v].stamp) v = w;
+  }
+  return v;
+#endif
+}
+
+static void lower_access(Cache *c, uint64_t tag, bool is_write);
+
+// return whether the line is hit
+static bool cache_access(Cache *c, uint64_t tag, bool is_write) {
+  c->access ++;
+  if (tag == c->last_tag) {
+    // the last line is already the most recently used one
+    if (is_write) {
+      if (MUXDEF(CONFIG_CACHESIM_WRITE_BACK, true, false)) c->last->dirty = true;
+      else lower_access(c, tag, true);
+    }
+    return true;
+  }
+
+  int set = tag & (c->nr_set - 1);
+  CacheLine *l = &c->line[set * c->nr_way];
+  for (int w = 0; w < c->nr_way; w ++) {
+    if (l[w].tag == tag) {
+      touch(c, set, w);
+      c->last_tag = tag;
+      c->last = &l[w];
+      if (is_write) {
+        if (MUXDEF(CONFIG_CACHESIM_WRITE_BACK, true, false)) l[w].dirty = true;
+        else lower_access(c, tag, true);
+      }
+      return true;
+    }
+  }
+
+  c->miss ++;
+#ifdef CONFIG_CACHESIM_WRITE_THROUGH
+  // no write allocate
+  if (is_write) {
+    lower_access(c, tag, true);
+    return false;
+  }
+#endif
+  int w = victim(c, set);
+  if (l[w].tag != INVALID_TAG && l[w].dirty) {
+    c->writeback ++;
+    lower_access(c, l[w].tag, true);
+  }
+  lower_access(c, tag, false);
+  l[w] = (CacheLine) { .tag = tag, .stamp = 0, .dirty = is_write };
+  touch(c, set, w);
+  c->last_tag = tag;
+  c->last = &l[w];
+  return false;
+}
+
+static void lower_access(Cache *c, uint64_t tag, bool is_write) {
+  if (c->next != NULL) {
+    if (!cache_access(c->next, tag, is_write)) pc_stat_get(cpu.pc)->miss[c->next - cache] ++;
+  } else if (is_write) mem_write ++;
+  else mem_read ++;
+}
+
+void cachesim_access(int type, vaddr_t addr, int len) {
+  Cache *c = &cache[type == CACHE_FETCH ? L1I : L1D];
+  bool is_write = (type == CACHE_WRITE);
+  uint64_t first = addr >> LINE_SHIFT, last = (addr + len - 1) >> LINE_SHIFT;
+  for (uint64_t tag = first; tag <= last; tag ++) {
+    if (!cache_access(c, tag, is_write)) pc_stat_get(cpu.pc)->miss[c - cache] ++;
+  }
+}
+
+static int pc_stat_cmp(const void *a, const void *b) {
+  const PCStat *x = a, *y = b;
+  uint64_t mx = x->miss[L1I] + x->miss[L1D], my = y->miss[L1I] + y->miss[L1D];
+  if (mx != my) return mx < my ? 1 : -1;
+  return x->miss[L2] < y->miss[L2] ? 1 : (x->miss[L2] > y->miss[L2] ? -1 : 0);
+}
+
+static void print_stat(FILE *fp, const PCStat *s, const char *name) {
+  fprintf(fp, "%12" PRIu64 " %12" PRIu64 " %12" PRIu64 "  %s\n",
+      s->miss[L1I], s->miss[L1D], s->miss[L2], name);
+}
+
+static void write_report() {
+  const char *path = CONFIG_CACHESIM_REPORT_PATH;
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) { perror(path); return; }
+
+  for (int i = 0; i < NR_CACHE; i ++) {
+    Cache *c = &cache[i];
+    fprintf(fp, "%-4s %5d sets x %2d ways: %" PRIu64 " accesses, %" PRIu64
+        " misses (%.2f%%), %" PRIu64 " write-backs\n", c->name, c->nr_set, c->nr_way,
+        c->access, c->miss, c->access ? 100.0 * c->miss / c->access : 0.0, c->writeback);
+  }
+  fprintf(fp, "memory: %" PRIu64 " line reads, %" PRIu64 " writes\n\n", mem_read, mem_write);
+
+  // compact the hash table into a sorted array
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < pc_stat_size; i ++) {
+    if (pc_stat[i].pc != 0) pc_stat[n ++] = pc_stat[i];
+  }
+  qsort(pc_stat, n, sizeof(PCStat), pc_stat_cmp);
+
+  int nr_func = ftrace_nr_func();
+  if (nr_func > 0) {
+    // slot 0 is for unknown functions, and `pc' holds the slot here
+    PCStat *func = calloc(nr_func + 1, sizeof(PCStat));
+    assert(func);
+    for (int i = 0; i <= nr_func; i ++) func[i].pc = i;
+    for (uint32_t i = 0; i < n; i ++) {
+      PCStat *f = &func[ftrace_find_func(pc_stat[i].pc) + 1];
+      for (int j = 0; j < NR_CACHE; j ++) f->miss[j] += pc_stat[i].miss[j];
+    }
+    qsort(func, nr_func + 1, sizeof(PCStat), pc_stat_cmp);
+    fprintf(fp, "%12s %12s %12s  %s\n", "L1I miss", "L1D miss", "L2 miss", "function");
+    for (int i = 0; i <= nr_func; i ++) {
+      if (func[i].miss[L1I] + func[i].miss[L1D] + func[i].miss[L2] == 0) break;
+      print_stat(fp, &func[i], ftrace_func_name((int)func[i].pc - 1));
+    }
+    fprintf(fp, "\n");
+    free(func);
+  }
+
+  fprintf(fp, "%12s %12s %12s  %s\n", "L1I miss", "L1D miss", "L2 miss", "pc");
+  for (uint32_t i = 0; i < n; i ++) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), FMT_WORD, pc_stat[i].pc);
+    print_stat(fp, &pc_stat[i], buf);
+  }
+  fclose(fp);
+  Log("Cache simulation report is written to %s", path);
+}
+
+static void cachesim_report() {
+  for (int i = 0; i < NR_CACHE; i ++) {
+    Cache *c = &cache[i];
+    if (c->access == 0) continue;
+    Log("%-4s accesses = %" PRIu64 ", miss rate = %.2f%%", c->name, c->access,
+        100.0 * c->miss / c->access);
+  }
+  write_report();
+}
+
+static void init_cache(Cache *c, const char *name, int size_kb, int nr_way, Cache *next) {
+  int nr_line = size_kb * 1024 / LINE_SIZE;
+  Assert(nr_way > 0, "%s: the number of ways must be positive", name);
+  Assert(nr_line % nr_way == 0, "%s: %d lines can not be divided into %d ways", name, nr_line, nr_way);
+  c->name = name;
+  c->nr_way = nr_way;
+  c->nr_set = nr_line / nr_way;
+  Assert(c->nr_set > 0, "%s: %d lines are fewer than %d ways", name, nr_line, nr_way);
+  Assert((c->nr_set & (c->nr_set - 1)) == 0, "%s: the number of sets must be a power of 2", name);
+  IFDEF(CONFIG_CACHESIM_PLRU, Assert((nr_way & (nr_way - 1)) == 0 && nr_way <= 64,
+        "%s: PLRU needs a power of 2 ways, at most 64", name));
+  c->line = malloc(sizeof(CacheLine) * nr_line);
+  assert(c->line);
+  for (int i = 0; i < nr_line; i ++) c->line[i] = (CacheLine) { .tag = INVALID_TAG };
+  c->plru = calloc(c->nr_set, sizeof(uint64_t));
+  assert(c->plru);
+  c->next = next;
+  c->last_tag = INVALID_TAG;
+}
+
+void init_cachesim() {
+  init_cache(&cache[L2], "L2", CONFIG_CACHESIM_L2_SIZE, CONFIG_CACHESIM_L2_WAYS, NULL);
+  init_cache(&cache[L1I], "L1I", CONFIG_CACHESIM_L1I_SIZE, CONFIG_CACHESIM_L1I_WAYS, &cache[L2]);
+  init_cache(&cache[L1D], "L1D", CONFIG_CACHESIM_L1D_SIZE, CONFIG_CACHESIM_L1D_WAYS, &cache[L2]);
+  atexit(cachesim_report);
+}
@@ -15,16 +15,44 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <cpu/perf.h>
+#include <memory/cachesim.h>
+#include <cpu/plugin.h>
+#include <utils.h>
+
+// the check costs one branch while mtrace is off
+#define mtrace(kind, addr, len, data) IFDEF(CONFIG_MITRACE, \
+  if (unlikely(g_mtrace_kind & (kind))) mtrace_record(kind, addr, len, data))
+#define plugin(kind, addr, len, data) IFDEF(CONFIG_PLUGIN, \
+  if (plugin_on(PLUGIN_MEM)) plugin_mem(kind, addr, len, data))
 
 //vaddr_ifetch 和 vaddr_read 是一样的诶，为了区分含义而分开?
 word_t vaddr_ifetch(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  cachesim(CACHE_FETCH, addr, len);
+  word_t data = paddr_read(addr, len);
+  mtrace(MTRACE_FETCH, addr, len, data);
+  plugin(NEMU_MEM_FETCH, addr, len, data);
+  return data;
 }
 
 word_t vaddr_read(vaddr_t addr, int len) {
+  perf_count(load);
+  cachesim(CACHE_READ, addr, len);
+  word_t data = paddr_read(addr, len);
+  mtrace(MTRACE_READ, addr, len, data);
+  plugin(NEMU_MEM_READ, addr, len, data);
+  return data;
+}
+
+// a read by the debugger, which is not counted, cached or traced
+word_t vaddr_peek(vaddr_t addr, int len) {
   return paddr_read(addr, len);
 }
 
 void vaddr_write(vaddr_t addr, int len, word_t data) {
+  perf_count(store);
+  cachesim(CACHE_WRITE, addr, len);
+  mtrace(MTRACE_WRITE, addr, len, data);
+  plugin(NEMU_MEM_WRITE, addr, len, data);
   paddr_write(addr, len, data);
 }
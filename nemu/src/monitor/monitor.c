@@ -15,6 +15,9 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/cachesim.h>
+#include <cpu/bpred.h>
+#include <cpu/plugin.h>
 
 void init_rand();
 void init_log(const char *log_file);
@@ -23,6 +26,7 @@ void init_difftest(char *ref_so_file, long img_size, int port);
 void init_device();
 void init_sdb();
 void init_disasm(const char *triple);
+void init_itrace_bin();
 
 static void welcome() {
   Log("Trace: %s", MUXDEF(CONFIG_TRACE, ANSI_FMT("ON", ANSI_FG_GREEN), ANSI_FMT("OFF", ANSI_FG_RED)));
@@ -47,6 +51,9 @@ static char *img_file = NULL;
 static int difftest_port = 1234;
 // elf_file path
 static char  *elf_file = NULL;
+static char *mtrace_spec = NULL;
+static char *plugin_spec[16] = {};
+static int nr_plugin = 0;
 
 static long load_img() {
   if (img_file == NULL) {
@@ -72,22 +79,29 @@ static long load_img() {
 
 static int parse_args(int argc, char *argv[]) {
   const struct option table[] = {
-    {"elf", no_argument, NULL,'e'},
+    {"elf"      , required_argument, NULL, 'e'},
     {"batch"    , no_argument      , NULL, 'b'},
     {"log"      , required_argument, NULL, 'l'},
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
+    {"mtrace"   , required_argument, NULL, 'm'},
+    {"plugin"   , required_argument, NULL, 'P'},
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:e:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhl:d:p:e:m:", table, NULL)) != -1) {
     switch (o) {
       case 'e': elf_file = optarg; break;
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg;break;
       case 'd': diff_so_file = optarg; break;
+      case 'm': mtrace_spec = optarg; break;
+      case 'P':
+        Assert(nr_plugin < ARRLEN(plugin_spec), "Too many plugins");
+        plugin_spec[nr_plugin ++] = optarg;
+        break;
       
       
       case 1: img_file = optarg; return 0;
@@ -98,6 +112,8 @@ static int parse_args(int argc, char *argv[]) {
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+        printf("\t-m,--mtrace=FILTER      trace the memory accesses passing FILTER\n");
+        printf("\t--plugin=LIB.so[,ARGS]  load an instrumentation plugin\n");
         printf("\n");
         exit(0);
     }
@@ -108,9 +124,6 @@ void parse_elf(const char *elf_file); // implemeted in <utils/itrace.c>
 void init_monitor(int argc, char *argv[]) {
   /* Perform some global initialization. */
 
-  /* Parse elf_file*/
-  parse_elf(elf_file);
-  
   /* Parse arguments. */
   parse_args(argc, argv);
   /* Set random seed. */
@@ -119,9 +132,31 @@ void init_monitor(int argc, char *argv[]) {
   /* Open the log file. */
   init_log(log_file);
 
+  /* Read the function symbols for ftrace. */
+  parse_elf(elf_file);
+
+  /* Start sampling the guest pc. */
+  IFDEF(CONFIG_PROFILER, init_profiler());
+
+  /* Set up the branch predictor models. */
+  IFDEF(CONFIG_BPRED, init_bpred());
+
+  /* Open the binary instruction trace. */
+  IFDEF(CONFIG_ITRACE_BINARY, init_itrace_bin());
+
+  /* Open the memory access trace. */
+#ifdef CONFIG_MITRACE
+  init_mtrace(mtrace_spec);
+#else
+  if (mtrace_spec != NULL) Log("mtrace is not enabled, --mtrace is ignored");
+#endif
+
   /* Initialize memory. */
   init_mem();
 
+  /* Set up the cache simulator. */
+  IFDEF(CONFIG_CACHESIM, init_cachesim());
+
   /* Initialize devices. */
   IFDEF(CONFIG_DEVICE, init_device());
 
@@ -134,6 +169,13 @@ void init_monitor(int argc, char *argv[]) {
   /* Initialize differential testing. */
   init_difftest(diff_so_file, img_size, difftest_port);
 
+  /* Load the instrumentation plugins. */
+#ifdef CONFIG_PLUGIN
+  for (int i = 0; i < nr_plugin; i ++) load_plugin(plugin_spec[i]);
+#else
+  if (nr_plugin > 0) Log("Plugins are not enabled, --plugin is ignored");
+#endif
+
   /* Initialize the simple debugger. */
   init_sdb();
 
@@ -133,7 +133,7 @@ static int cmd_x(char *args) {
         printf("0x%08x: ", addr + i);
       }
       vaddr_t vaddr = addr + i;
-      printf("0x%02x ", vaddr_read(vaddr, 1));
+      printf("0x%02x ", vaddr_peek(vaddr, 1));
       if ((i + 1) % 4 == 0) {
         printf("\n");
       }
@@ -166,6 +166,17 @@ static int cmd_d(char *args){
     printf("Failed to delete watchpoint\n");
   return 0;
 }
+#ifdef CONFIG_MITRACE
+static int cmd_mtrace(char *args) {
+  if (args == NULL) {
+    printf("Usage: mtrace FILTER, e.g. mtrace w addr=0x80001000-0x80002000\n");
+    return 0;
+  }
+  if (mtrace_config(args)) printf("mtrace filter: %s\n", args);
+  return 0;
+}
+#endif
+
 static struct {
   const char *name;
   const char *description;
@@ -184,7 +195,11 @@ static struct {
     {"p", "p EXPR: Calculate the value of the expression", cmd_p},
     {"x", "x N EXPR: Scan memory from expr", cmd_x},
     {"w", "w EXPR: Watch the value of EXPR", cmd_w},
-    {"d", "d p: Delete Watchpoint p",cmd_d}
+    {"d", "d p: Delete Watchpoint p",cmd_d},
+#ifdef CONFIG_MITRACE
+    {"mtrace", "mtrace FILTER: Trace the memory accesses passing FILTER, "
+     "e.g. rwx addr=LO-HI pc=LO-HI, or off", cmd_mtrace},
+#endif
 };
 
 #define NR_CMD ARRLEN(cmd_table)
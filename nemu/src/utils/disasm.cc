@@ -22,6 +22,7 @@
 #include "llvm/MC/MCContext.h"
 #include "llvm/MC/MCDisassembler/MCDisassembler.h"
 #include "llvm/MC/MCInstPrinter.h"
+#include "llvm/MC/MCInstrInfo.h"
 #if LLVM_VERSION_MAJOR >= 14
 #include "llvm/MC/TargetRegistry.h"
 #if LLVM_VERSION_MAJOR >= 15
@@ -36,6 +37,9 @@
 #pragma GCC diagnostic pop
 #endif
 
+#include <cinttypes>
+#include <strings.h>
+
 #if LLVM_VERSION_MAJOR < 11
 #error Please use LLVM with major version >= 11
 #endif
@@ -45,17 +49,79 @@ using namespace llvm;
 static llvm::MCDisassembler *gDisassembler = nullptr;
 static llvm::MCSubtargetInfo *gSTI = nullptr;
 static llvm::MCInstPrinter *gIP = nullptr;
+static llvm::MCInstrInfo *gMII = nullptr;
+static uint64_t gAddrMask = 0;
+
+// A program has only a few thousand distinct instructions, so rendered
+// instructions are cached by their encoding. For an instruction with a
+// PC-relative operand, the printed target address is cut out of the
+// text, and patched in again for the pc of every lookup.
+#define CACHE_SIZE 16384
+#define CACHE_TEXT 112
+
+struct DisasmEntry {
+  uint64_t code;
+  uint8_t nbyte;  // 0 for an empty entry
+  bool pcrel;
+  uint16_t pos, len;  // where the target address is in `text`
+  int64_t imm;
+  char text[CACHE_TEXT];
+};
+
+static DisasmEntry gCache[CACHE_SIZE];
+
+static DisasmEntry *cache_slot(uint64_t code, int nbyte) {
+  uint64_t h = (code ^ nbyte) * 0x9e3779b97f4a7c15ull;
+  return &gCache[(h >> 32) % CACHE_SIZE];
+}
+
+// Setting up LLVM takes a noticeable share of the startup time, so it is
+// deferred until the first instruction is rendered, and only the guest
+// target is registered.
+static std::string gTriple;
+
+struct TargetInit {
+  const char *name;
+  void (*init)();
+};
+
+static const TargetInit gTargetInfos[] = {
+#define LLVM_TARGET(T) { #T, LLVMInitialize##T##TargetInfo },
+#include "llvm/Config/Targets.def"
+};
+
+static const TargetInit gTargetMCs[] = {
+#define LLVM_TARGET(T) { #T, LLVMInitialize##T##TargetMC },
+#include "llvm/Config/Targets.def"
+};
+
+static const TargetInit gDisassemblers[] = {
+#define LLVM_DISASSEMBLER(T) { #T, LLVMInitialize##T##Disassembler },
+#include "llvm/Config/Disassemblers.def"
+};
+
+template <size_t N>
+static void init_target(const TargetInit (&table)[N], const char *name) {
+  for (auto &t : table) {
+    if (strcasecmp(t.name, name) == 0) { t.init(); return; }
+  }
+  llvm::errs() << "LLVM is built without the " << name << " target\n";
+  assert(0);
+}
 
 extern "C" void init_disasm(const char *triple) {
-  llvm::InitializeAllTargetInfos();
-  llvm::InitializeAllTargetMCs();
-  llvm::InitializeAllAsmParsers();
-  llvm::InitializeAllDisassemblers();
+  gTriple = triple;
+}
+
+static void setup_disasm() {
+  // e.g. "riscv" for riscv32, the target is called "RISCV" by LLVM
+  std::string arch = llvm::Triple::getArchTypePrefix(llvm::Triple(gTriple).getArch()).str();
+  init_target(gTargetInfos, arch.c_str());
+  init_target(gTargetMCs, arch.c_str());
+  init_target(gDisassemblers, arch.c_str());
 
   std::string errstr;
-  std::string gTriple(triple);
 
-  llvm::MCInstrInfo *gMII = nullptr;
   llvm::MCRegisterInfo *gMRI = nullptr;
   auto target = llvm::TargetRegistry::lookupTarget(gTriple, errstr);
   if (!target) {
@@ -77,7 +143,7 @@ extern "C" void init_disasm(const char *triple) {
   gMRI = target->createMCRegInfo(gTriple);
   auto AsmInfo = target->createMCAsmInfo(*gMRI, gTriple, MCOptions);
 #if LLVM_VERSION_MAJOR >= 13
-   auto llvmTripleTwine = Twine(triple);
+   auto llvmTripleTwine = Twine(gTriple);
    auto llvmtriple = llvm::Triple(llvmTripleTwine);
    auto Ctx = new llvm::MCContext(llvmtriple,AsmInfo, gMRI, nullptr);
 #else
@@ -90,9 +156,11 @@ extern "C" void init_disasm(const char *triple) {
   gIP->setPrintBranchImmAsAddress(true);
   if (isa == "riscv32" || isa == "riscv64")
     gIP->applyTargetSpecificCLOption("no-aliases");
+  gAddrMask = (llvm::Triple(gTriple).isArch64Bit() ? ~0ull : 0xffffffffull);
 }
 
-extern "C" void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte) {
+static void render(char *str, int size, uint64_t pc, uint8_t *code, int nbyte, DisasmEntry *e) {
+  if (gDisassembler == nullptr) setup_disasm();
   MCInst inst;
   llvm::ArrayRef<uint8_t> arr(code, nbyte);
   uint64_t dummy_size = 0;
@@ -106,4 +174,53 @@ extern "C" void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int
   const char *p = s.c_str() + skip;
   assert((int)s.length() - skip < size);
   strcpy(str, p);
+
+  if (e == nullptr || strlen(p) >= CACHE_TEXT) return;
+  *e = DisasmEntry();
+  const MCInstrDesc &desc = gMII->get(inst.getOpcode());
+  unsigned i = 0;
+  for (auto &op : desc.operands()) {
+    if (op.OperandType == MCOI::OPERAND_PCREL && i < inst.getNumOperands() && inst.getOperand(i).isImm()) {
+      // find the target as printed; if it is not there, do not cache
+      char target[32];
+      int64_t imm = inst.getOperand(i).getImm();
+      snprintf(target, sizeof(target), "0x%" PRIx64, (pc + imm) & gAddrMask);
+      const char *t = strstr(p, target);
+      if (t == nullptr) return;
+      e->pcrel = true;
+      e->imm = imm;
+      e->pos = t - p;
+      e->len = strlen(target);
+      break;
+    }
+    i ++;
+  }
+  memcpy(&e->code, code, nbyte);
+  e->nbyte = nbyte;
+  strcpy(e->text, p);
+}
+
+extern "C" void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte) {
+  if (nbyte > (int)sizeof(uint64_t)) {
+    render(str, size, pc, code, nbyte, nullptr);
+    return;
+  }
+
+  uint64_t key = 0;
+  memcpy(&key, code, nbyte);
+  DisasmEntry *e = cache_slot(key, nbyte);
+  if (e->nbyte != nbyte || e->code != key) {
+    render(str, size, pc, code, nbyte, e);
+    return;
+  }
+
+  if (!e->pcrel) {
+    assert((int)strlen(e->text) < size);
+    strcpy(str, e->text);
+    return;
+  }
+  char target[32];
+  snprintf(target, sizeof(target), "0x%" PRIx64, (pc + e->imm) & gAddrMask);
+  int n = snprintf(str, size, "%.*s%s%s", e->pos, e->text, target, e->text + e->pos + e->len);
+  assert(n < size);
 }
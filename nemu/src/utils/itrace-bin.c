@@ -0,0 +1,36 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <utils.h>
+
+typedef struct __attribute__((packed)) {
+  word_t pc;
+  uint32_t inst;
+  IFDEF(CONFIG_ITRACE_BINARY_RD, word_t rd);
+} ITraceRec;
+
+static TraceFile trace = {};
+
+void itrace_bin_write(vaddr_t pc, uint32_t inst, word_t rd) {
+  *(ITraceRec *)trace_file_append(&trace, sizeof(ITraceRec)) =
+    (ITraceRec) { .pc = pc, .inst = inst, IFDEF(CONFIG_ITRACE_BINARY_RD, .rd = rd) };
+}
+
+void init_itrace_bin() {
+  const char *path = CONFIG_ITRACE_BINARY_PATH;
+  trace_file_open(&trace, path, ITRACE_MAGIC,
+      MUXDEF(CONFIG_ITRACE_BINARY_RD, 1, 0), sizeof(ITraceRec));
+  Log("Binary instruction trace is written to %s", path);
+}
@@ -2,6 +2,8 @@
 #include <elf.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #define MAX_IRINGBUFFER_SIZE 16
 typedef struct {
   word_t pc;
@@ -34,9 +36,13 @@ void display_inst() {
   char *p;
   do {
     p = buf;
-    p += sprintf(p, "%s" FMT_WORD ":%8x",
+    p += sprintf(p, "%s" FMT_WORD ": %08x  ",
                  (i + 1) % MAX_IRINGBUFFER_SIZE == end ? " --> " : "     ",
                  iringBuffer.buffer[i].pc, iringBuffer.buffer[i].inst);
+#if defined(CONFIG_ITRACE) && !defined(CONFIG_ISA_loongarch32r)
+    disassemble(p, buf + sizeof(buf) - p, iringBuffer.buffer[i].pc,
+                (uint8_t *)&iringBuffer.buffer[i].inst, 4);
+#endif
     if ((i + 1) % MAX_IRINGBUFFER_SIZE == end) {
       printf(ANSI_FG_RED);
     }
@@ -45,40 +51,68 @@ void display_inst() {
   printf(ANSI_NONE);
 }
 
-void display_mem_addr(word_t addr, int len) {
-  printf("addr = " FMT_WORD ", len = %d\n", addr, len);
-}
-
 
 // --------------------------ftrace-----------------------------------------
 // reference: https://git.lug.ustc.edu.cn/nos-ae/pa-tmp/-/blob/main/itrace.c 
 
 typedef struct {
-	char name[32]; // func name, 32 should be enough
 	paddr_t addr;
-	unsigned char info;
-	Elf64_Xword size;
+	paddr_t size;
+	const char *name; // points into the mapped string table
 } SymEntry;
 
-SymEntry *symbol_tbl = NULL; // dynamic allocated
-int symbol_tbl_size = 0;
-int call_depth = 0;
+// STT_FUNC symbols sorted by address, looked up with binary search
+static SymEntry *symbol_tbl = NULL;
+static int symbol_tbl_size = 0;
 
-typedef struct tail_rec_node {
+// symbol index of every active function, innermost last
+static int *call_stack = NULL;
+static int call_depth = 0, call_stack_cap = 0;
+
+typedef struct {
 	paddr_t pc;
-	paddr_t depend;
-	struct tail_rec_node *next;
-} TailRecNode;
-TailRecNode *tail_rec_head = NULL; // linklist with head, dynamic allocated
+	int func; // symbol index of the tail call target
+} TailRec;
 
-static void read_elf_header(int fd, Elf64_Ehdr *eh) {
-	assert(lseek(fd, 0, SEEK_SET) == 0);
-  assert(read(fd, (void *)eh, sizeof(Elf64_Ehdr)) == sizeof(Elf64_Ehdr));
+// pending tail calls, a stack which only grows on a deeper chain than seen before
+static TailRec *tail_rec = NULL;
+static int tail_rec_top = 0, tail_rec_cap = 0;
 
-	  // check if is elf using fixed format of Magic: 7f 45 4c 46 ...
-  if(strncmp((char*)eh->e_ident, "\177ELF", 4)) {
+static uint8_t *elf_img = NULL; // the whole ELF file mapped read-only
+static size_t elf_img_size = 0;
+
+// ELF32 headers are widened to their ELF64 form, so the rest of the
+// parser only deals with one layout
+static bool elf_is_64 = false;
+
+static void read_elf_header(Elf64_Ehdr *eh) {
+	// check if is elf using fixed format of Magic: 7f 45 4c 46 ...
+	if (elf_img_size < EI_NIDENT || strncmp((char *)elf_img, "\177ELF", 4)) {
 		panic("malformed ELF file");
 	}
+	elf_is_64 = (elf_img[EI_CLASS] == ELFCLASS64);
+	if (elf_is_64) {
+		Assert(elf_img_size >= sizeof(Elf64_Ehdr), "truncated ELF header");
+		memcpy(eh, elf_img, sizeof(Elf64_Ehdr));
+		return;
+	}
+
+	Assert(elf_img_size >= sizeof(Elf32_Ehdr), "truncated ELF header");
+	Elf32_Ehdr *e = (Elf32_Ehdr *)elf_img;
+	memcpy(eh->e_ident, e->e_ident, EI_NIDENT);
+	eh->e_type = e->e_type;
+	eh->e_machine = e->e_machine;
+	eh->e_version = e->e_version;
+	eh->e_entry = e->e_entry;
+	eh->e_phoff = e->e_phoff;
+	eh->e_shoff = e->e_shoff;
+	eh->e_flags = e->e_flags;
+	eh->e_ehsize = e->e_ehsize;
+	eh->e_phentsize = e->e_phentsize;
+	eh->e_phnum = e->e_phnum;
+	eh->e_shentsize = e->e_shentsize;
+	eh->e_shnum = e->e_shnum;
+	eh->e_shstrndx = e->e_shstrndx;
 }
 
 static void display_elf_hedaer(Elf64_Ehdr eh) {
@@ -304,25 +338,40 @@ static void display_elf_hedaer(Elf64_Ehdr eh) {
 	log_write("\n");	/* End of ELF header */
 }
 
-static void read_section(int fd, Elf64_Shdr sh, void *dst) {
-	assert(dst != NULL);
-	assert(lseek(fd, (off_t)sh.sh_offset, SEEK_SET) == (off_t)sh.sh_offset);
-	assert(read(fd, dst, sh.sh_size) == sh.sh_size);
+static void *elf_section(Elf64_Shdr *sh) {
+	Assert(sh->sh_offset + sh->sh_size <= elf_img_size, "section out of the ELF file");
+	return elf_img + sh->sh_offset;
 }
 
-static void read_section_headers(int fd, Elf64_Ehdr eh, Elf64_Shdr *sh_tbl) {
-	assert(lseek(fd, eh.e_shoff, SEEK_SET) == eh.e_shoff);
-	for(int i = 0; i < eh.e_shnum; i++) {
-		assert(read(fd, (void *)&sh_tbl[i], eh.e_shentsize) == eh.e_shentsize);
+static Elf64_Shdr *read_section_headers(Elf64_Ehdr eh) {
+	Assert(eh.e_shoff + (uint64_t)eh.e_shentsize * eh.e_shnum <= elf_img_size,
+		"section headers out of the ELF file");
+	Elf64_Shdr *sh_tbl = malloc(sizeof(Elf64_Shdr) * eh.e_shnum);
+	assert(sh_tbl);
+	for (int i = 0; i < eh.e_shnum; i++) {
+		uint8_t *p = elf_img + eh.e_shoff + (uint64_t)eh.e_shentsize * i;
+		if (elf_is_64) {
+			memcpy(&sh_tbl[i], p, sizeof(Elf64_Shdr));
+			continue;
+		}
+		Elf32_Shdr *s = (Elf32_Shdr *)p;
+		sh_tbl[i].sh_name = s->sh_name;
+		sh_tbl[i].sh_type = s->sh_type;
+		sh_tbl[i].sh_flags = s->sh_flags;
+		sh_tbl[i].sh_addr = s->sh_addr;
+		sh_tbl[i].sh_offset = s->sh_offset;
+		sh_tbl[i].sh_size = s->sh_size;
+		sh_tbl[i].sh_link = s->sh_link;
+		sh_tbl[i].sh_info = s->sh_info;
+		sh_tbl[i].sh_addralign = s->sh_addralign;
+		sh_tbl[i].sh_entsize = s->sh_entsize;
 	}
+	return sh_tbl;
 }
 
-static void display_section_headers(int fd, Elf64_Ehdr eh, Elf64_Shdr sh_tbl[]) {
-  // warn: C99
-	char sh_str[sh_tbl[eh.e_shstrndx].sh_size];
-  read_section(fd, sh_tbl[eh.e_shstrndx], sh_str);
-  
+static void display_section_headers(Elf64_Ehdr eh, Elf64_Shdr sh_tbl[]) {
 	/* Read section-header string-table */
+	const char *sh_str = elf_section(&sh_tbl[eh.e_shstrndx]);
 
 	log_write("========================================");
 	log_write("========================================\n");
@@ -347,155 +396,200 @@ static void display_section_headers(int fd, Elf64_Ehdr eh, Elf64_Shdr sh_tbl[])
 	log_write("\n");	/* end of section header table */
 }
 
-static void read_symbol_table(int fd, Elf64_Ehdr eh, Elf64_Shdr sh_tbl[], int sym_idx) {
-  Elf64_Sym sym_tbl[sh_tbl[sym_idx].sh_size];
-  read_section(fd, sh_tbl[sym_idx], sym_tbl);
-  
-  int str_idx = sh_tbl[sym_idx].sh_link;
-  char str_tbl[sh_tbl[str_idx].sh_size];
-  read_section(fd, sh_tbl[str_idx], str_tbl);
-  
-  int sym_count = (sh_tbl[sym_idx].sh_size / sizeof(Elf64_Sym));
+static void read_sym(void *tbl, int i, Elf64_Sym *sym) {
+	if (elf_is_64) {
+		*sym = ((Elf64_Sym *)tbl)[i];
+		return;
+	}
+	Elf32_Sym *s = &((Elf32_Sym *)tbl)[i];
+	sym->st_name = s->st_name;
+	sym->st_info = s->st_info;
+	sym->st_other = s->st_other;
+	sym->st_shndx = s->st_shndx;
+	sym->st_value = s->st_value;
+	sym->st_size = s->st_size;
+}
+
+static void read_symbol_table(Elf64_Shdr sh_tbl[], int sym_idx) {
+	void *sym_tbl = elf_section(&sh_tbl[sym_idx]);
+	const char *str_tbl = elf_section(&sh_tbl[sh_tbl[sym_idx].sh_link]);
+
+	int sym_count = sh_tbl[sym_idx].sh_size / (elf_is_64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym));
 	// log
-  log_write("Symbol count: %d\n", sym_count);
-  log_write("====================================================\n");
-  log_write(" num    value            type size       name\n");
-  log_write("====================================================\n");
-  for (int i = 0; i < sym_count; i++) {
-    log_write(" %-3d    %016lx %-4d %-10ld %s\n",
-      i,
-      sym_tbl[i].st_value, 
-      ELF64_ST_TYPE(sym_tbl[i].st_info),
-			sym_tbl[i].st_size,
-      str_tbl + sym_tbl[i].st_name
-    );
-  }
-  log_write("====================================================\n\n");
-
-	// read
-	symbol_tbl_size = sym_count;
-	symbol_tbl = malloc(sizeof(SymEntry) * sym_count);
-  for (int i = 0; i < sym_count; i++) {
-    symbol_tbl[i].addr = sym_tbl[i].st_value;
-		symbol_tbl[i].info = sym_tbl[i].st_info;
-		symbol_tbl[i].size = sym_tbl[i].st_size;
-		memset(symbol_tbl[i].name, 0, 32);
-		strncpy(symbol_tbl[i].name, str_tbl + sym_tbl[i].st_name, 31);
-  }
+	log_write("Symbol count: %d\n", sym_count);
+	log_write("====================================================\n");
+	log_write(" num    value            type size       name\n");
+	log_write("====================================================\n");
+	Elf64_Sym sym;
+	int nr_func = 0;
+	for (int i = 0; i < sym_count; i++) {
+		read_sym(sym_tbl, i, &sym);
+		log_write(" %-3d    %016lx %-4d %-10ld %s\n",
+			i,
+			sym.st_value,
+			ELF64_ST_TYPE(sym.st_info),
+			sym.st_size,
+			str_tbl + sym.st_name
+		);
+		if (ELF64_ST_TYPE(sym.st_info) == STT_FUNC) nr_func ++;
+	}
+	log_write("====================================================\n\n");
+
+	// only functions are ever looked up, so keep just those
+	symbol_tbl = realloc(symbol_tbl, sizeof(SymEntry) * (symbol_tbl_size + nr_func));
+	assert(symbol_tbl);
+	for (int i = 0; i < sym_count; i++) {
+		read_sym(sym_tbl, i, &sym);
+		if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC) continue;
+		SymEntry *e = &symbol_tbl[symbol_tbl_size ++];
+		e->addr = sym.st_value;
+		e->size = sym.st_size;
+		e->name = str_tbl + sym.st_name;
+	}
 }
 
-static void read_symbols(int fd, Elf64_Ehdr eh, Elf64_Shdr sh_tbl[]) {
-  for (int i = 0; i < eh.e_shnum; i++) {
+static void read_symbols(Elf64_Ehdr eh, Elf64_Shdr sh_tbl[]) {
+	for (int i = 0; i < eh.e_shnum; i++) {
 		switch (sh_tbl[i].sh_type) {
 		case SHT_SYMTAB: case SHT_DYNSYM:
-			read_symbol_table(fd, eh, sh_tbl, i); break;
+			read_symbol_table(sh_tbl, i); break;
 		}
-  }
+	}
 }
 
-static void init_tail_rec_list() {
-	tail_rec_head = (TailRecNode *)malloc(sizeof(TailRecNode));
-	tail_rec_head->pc = 0;
-	tail_rec_head->next = NULL;
+// aliases at the same address are ordered by size, so the last of them
+// covers the most
+static int sym_cmp(const void *a, const void *b) {
+	const SymEntry *x = a, *y = b;
+	if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+	return x->size < y->size ? -1 : (x->size > y->size);
 }
 
-/* ELF64 as default */
+/* both ELF32 and ELF64 are accepted */
 void parse_elf(const char *elf_file) {
-  if (elf_file == NULL) return;
-  
+	if (elf_file == NULL) return;
+
 	Log("specified ELF file: %s", elf_file);
-  int fd = open(elf_file, O_RDONLY|O_SYNC);
-  Assert(fd >= 0, "Error %d: unable to open %s\n", fd, elf_file);
-  
-  Elf64_Ehdr eh;
-	read_elf_header(fd, &eh);
-  display_elf_hedaer(eh);
+	int fd = open(elf_file, O_RDONLY);
+	Assert(fd >= 0, "Error %d: unable to open %s\n", fd, elf_file);
+
+	struct stat st;
+	int ret = fstat(fd, &st);
+	Assert(ret == 0, "unable to stat %s", elf_file);
+	elf_img_size = st.st_size;
+	elf_img = mmap(NULL, elf_img_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	Assert(elf_img != MAP_FAILED, "unable to map %s", elf_file);
+	close(fd);
 
-  Elf64_Shdr sh_tbl[eh.e_shentsize * eh.e_shnum];
-	read_section_headers(fd, eh, sh_tbl);
-  display_section_headers(fd, eh, sh_tbl);
+	Elf64_Ehdr eh;
+	read_elf_header(&eh);
+	display_elf_hedaer(eh);
 
-  read_symbols(fd, eh, sh_tbl);
+	Elf64_Shdr *sh_tbl = read_section_headers(eh);
+	display_section_headers(eh, sh_tbl);
 
-	init_tail_rec_list();
+	read_symbols(eh, sh_tbl);
+	free(sh_tbl);
+	qsort(symbol_tbl, symbol_tbl_size, sizeof(SymEntry), sym_cmp);
 
-	close(fd);
+	call_stack_cap = 1024;
+	call_stack = malloc(sizeof(int) * call_stack_cap);
+	assert(call_stack);
+	tail_rec_cap = 1024;
+	tail_rec = malloc(sizeof(TailRec) * tail_rec_cap);
+	assert(tail_rec);
 }
 
 static int find_symbol_func(paddr_t target, bool is_call) {
-	int i;
-	for (i = 0; i < symbol_tbl_size; i++) {
-		if (ELF64_ST_TYPE(symbol_tbl[i].info) == STT_FUNC) {
-			if (is_call) {
-				if (symbol_tbl[i].addr == target) break;
-			} else {
-				if (symbol_tbl[i].addr <= target && target < symbol_tbl[i].addr + symbol_tbl[i].size) break;
-			}
-		}
+	// the last symbol starting at or below target
+	int lo = 0, hi = symbol_tbl_size;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (symbol_tbl[mid].addr <= target) lo = mid + 1;
+		else hi = mid;
 	}
-	return i<symbol_tbl_size?i:-1;
-}
-
-static void insert_tail_rec(paddr_t pc, paddr_t depend) {
-	TailRecNode *node = (TailRecNode *)malloc(sizeof(TailRecNode));
-	node->pc = pc;
-	node->depend = depend;
-	node->next = tail_rec_head->next;
-	tail_rec_head->next = node;
+	int i = lo - 1;
+	if (i < 0) return -1;
+	if (is_call) return symbol_tbl[i].addr == target ? i : -1;
+	return target < symbol_tbl[i].addr + symbol_tbl[i].size ? i : -1;
 }
 
-static void remove_tail_rec() {
-	TailRecNode *node = tail_rec_head->next;
-	tail_rec_head->next = node->next;
-	free(node);
+static void insert_tail_rec(paddr_t pc, int func) {
+	if (tail_rec_top == tail_rec_cap) {
+		tail_rec_cap *= 2;
+		tail_rec = realloc(tail_rec, sizeof(TailRec) * tail_rec_cap);
+		assert(tail_rec);
+	}
+	tail_rec[tail_rec_top ++] = (TailRec){ .pc = pc, .func = func };
 }
 
 void trace_func_call(paddr_t pc, paddr_t target, bool is_tail) {
 	if (symbol_tbl == NULL) return;
 
-	++call_depth;
+	int i = find_symbol_func(target, true);
+	if (call_depth == call_stack_cap) {
+		call_stack_cap *= 2;
+		call_stack = realloc(call_stack, sizeof(int) * call_stack_cap);
+		assert(call_stack);
+	}
+	call_stack[call_depth ++] = i;
 
-	if (call_depth <= 2) return; // ignore _trm_init & main
+	if (is_tail) {
+		insert_tail_rec(pc, i);
+	}
 
-	int i = find_symbol_func(target, true);
-  printf("call\n");
+#ifdef CONFIG_ITRACE
+	if (call_depth <= 2) return; // ignore _trm_init & main
 	log_write(FMT_PADDR ": %*scall [%s@" FMT_PADDR "]\n",
 		pc,
 		(call_depth-3)*2, "",
 		i>=0?symbol_tbl[i].name:"???",
 		target
 	);
-
-	if (is_tail) {
-		insert_tail_rec(pc, target);
-	}
+#endif
 }
 
 void trace_func_ret(paddr_t pc) {
 	if (symbol_tbl == NULL) return;
-	
-	if (call_depth <= 2) return; // ignore _trm_init & main
 
-	int i = find_symbol_func(pc, false);
-	log_write(FMT_PADDR ": %*sret [%s]\n",
-		pc,
-		(call_depth-3)*2, "",
-		i>=0?symbol_tbl[i].name:"???"
-	);
-	
-	--call_depth;
-
-	TailRecNode *node = tail_rec_head->next;
-	if (node != NULL) {
-		int depend_i = find_symbol_func(node->depend, true);
-		if (depend_i == i) {
-			paddr_t ret_target = node->pc;
-			remove_tail_rec();
-			trace_func_ret(ret_target);
+	while (call_depth > 0) {
+		int i = find_symbol_func(pc, false);
+#ifdef CONFIG_ITRACE
+		if (call_depth > 2) { // ignore _trm_init & main
+			log_write(FMT_PADDR ": %*sret [%s]\n",
+				pc,
+				(call_depth-3)*2, "",
+				i>=0?symbol_tbl[i].name:"???"
+			);
 		}
+#endif
+
+		--call_depth;
+
+		// returning from a tail callee also returns from the function which
+		// made the tail call
+		if (tail_rec_top == 0 || tail_rec[tail_rec_top - 1].func != i) break;
+		pc = tail_rec[-- tail_rec_top].pc;
 	}
 }
 
+int ftrace_find_func(paddr_t pc) {
+	return symbol_tbl == NULL ? -1 : find_symbol_func(pc, false);
+}
+
+const char *ftrace_func_name(int i) {
+	return i >= 0 ? symbol_tbl[i].name : "???";
+}
+
+int ftrace_nr_func() {
+	return symbol_tbl_size;
+}
+
+int ftrace_call_stack(const int **frames) {
+	*frames = call_stack;
+	return call_depth;
+}
+
 // typedef struct { // A Symbol Table item
 //   paddr_t addr;
 //   char name[32];
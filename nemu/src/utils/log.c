@@ -14,19 +14,141 @@
 ***************************************************************************************/
 
 #include <common.h>
+#include <stdarg.h>
 
 extern uint64_t g_nr_guest_inst;
 
 #ifndef CONFIG_TARGET_AM
 FILE *log_fp = NULL;
 
+#ifdef CONFIG_LOG_ASYNC
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Messages are formatted on the CPU thread into a single-producer/
+// single-consumer ring, which a writer thread drains into the log file.
+// The positions are free-running byte counts. Messages from other threads
+// (device threads, a failing Assert) are rare, so they are written to the
+// file directly under a lock instead of becoming a second producer.
+#define RING_SIZE ((uint64_t)CONFIG_LOG_ASYNC_BUF_SIZE * 1024)
+
+static char *ring = NULL;
+static atomic_uint_fast64_t ring_w = 0, ring_r = 0;
+static bool async = false;
+static uint64_t nr_drop = 0;
+static pthread_t cpu_thread;
+static pthread_mutex_t sync_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *log_writer(void *arg) {
+  int fd = fileno(log_fp);
+  while (true) {
+    uint64_t r = atomic_load_explicit(&ring_r, memory_order_relaxed);
+    uint64_t w = atomic_load_explicit(&ring_w, memory_order_acquire);
+    if (r == w) { usleep(1000); continue; }
+    // write up to the end of the ring, the rest goes with the next call
+    uint64_t off = r % RING_SIZE;
+    uint64_t len = (w - r < RING_SIZE - off ? w - r : RING_SIZE - off);
+    ssize_t n = write(fd, ring + off, len);
+    if (n <= 0) { perror("log write"); n = len; }
+    atomic_store_explicit(&ring_r, r + n, memory_order_release);
+  }
+  return NULL;
+}
+
+static void ring_put(const char *buf, uint64_t len) {
+  uint64_t w = atomic_load_explicit(&ring_w, memory_order_relaxed);
+  if (len > RING_SIZE) { nr_drop ++; return; }
+  while (w + len - atomic_load_explicit(&ring_r, memory_order_acquire) > RING_SIZE) {
+#ifdef CONFIG_LOG_ASYNC_FULL_DROP
+    nr_drop ++;
+    return;
+#else
+    usleep(100);
+#endif
+  }
+  uint64_t off = w % RING_SIZE;
+  uint64_t first = (len < RING_SIZE - off ? len : RING_SIZE - off);
+  memcpy(ring + off, buf, first);
+  memcpy(ring, buf + first, len - first);
+  atomic_store_explicit(&ring_w, w + len, memory_order_release);
+}
+
+static void init_async() {
+  ring = malloc(RING_SIZE);
+  assert(ring);
+  pthread_t tid;
+  int ret = pthread_create(&tid, NULL, log_writer, NULL);
+  assert(ret == 0);
+  pthread_detach(tid);
+  cpu_thread = pthread_self();
+  async = true;
+}
+#endif
+
+void log_printf(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+#ifdef CONFIG_LOG_ASYNC
+  if (async && !pthread_equal(pthread_self(), cpu_thread)) {
+    pthread_mutex_lock(&sync_lock);
+    vfprintf(log_fp, fmt, ap);
+    fflush(log_fp);
+    pthread_mutex_unlock(&sync_lock);
+    va_end(ap);
+    return;
+  }
+  if (async) {
+    char buf[512];
+    va_list ap2;
+    va_copy(ap2, ap);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    if (n < sizeof(buf)) ring_put(buf, n);
+    else {
+      char *p = malloc(n + 1);
+      vsnprintf(p, n + 1, fmt, ap2);
+      ring_put(p, n);
+      free(p);
+    }
+    va_end(ap2);
+    va_end(ap);
+    return;
+  }
+#endif
+  vfprintf(log_fp, fmt, ap);
+  fflush(log_fp);
+  va_end(ap);
+}
+
+// Wait until everything logged so far is in the log file. This is called
+// at exit and before an assertion fails, so the last messages before a
+// crash are never lost.
+void log_flush() {
+  if (log_fp == NULL) return;
+#ifdef CONFIG_LOG_ASYNC
+  if (async) {
+    while (atomic_load_explicit(&ring_r, memory_order_acquire) !=
+           atomic_load_explicit(&ring_w, memory_order_relaxed)) usleep(100);
+    if (nr_drop > 0) {
+      fprintf(log_fp, "[%" PRIu64 " log messages dropped]\n", nr_drop);
+      nr_drop = 0;
+    }
+  }
+#endif
+  fflush(log_fp);
+}
+
 void init_log(const char *log_file) {
   log_fp = stdout;
   if (log_file != NULL) {
     FILE *fp = fopen(log_file, "w");
     Assert(fp, "Can not open '%s'", log_file);
     log_fp = fp;
+    // stdout is shared with printf(), so only a log file is written
+    // asynchronously
+    IFDEF(CONFIG_LOG_ASYNC, init_async());
   }
+  atexit(log_flush);
   Log("Log is written to %s", log_file ? log_file : "stdout");
 }
 
@@ -0,0 +1,125 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <utils.h>
+
+// Guest memory accesses are appended to a binary trace file (see
+// <cpu/itrace.h>) when they pass the filter. A filter is a list of terms
+// separated by spaces or commas:
+//
+//   r, w, x or a combination   the kinds of accesses to trace (default rw)
+//   addr=LO-HI                 only accesses overlapping [LO, HI)
+//   pc=LO-HI                   only accesses by instructions in [LO, HI)
+//   off                        stop tracing
+//
+// Ranges of the same type are ORed, and a new filter replaces the old one.
+
+#define MAX_RANGE 8
+
+typedef struct {
+  vaddr_t lo, hi;
+} Range;
+
+typedef struct {
+  uint32_t kind;
+  Range addr[MAX_RANGE], pc[MAX_RANGE];
+  int nr_addr, nr_pc;
+} MTraceFilter;
+
+typedef struct __attribute__((packed)) {
+  word_t pc;
+  word_t addr;
+  uint8_t kind;
+  uint8_t len;
+  IFDEF(CONFIG_MITRACE_VALUE, word_t data);
+} MTraceRec;
+
+uint32_t g_mtrace_kind = 0;
+static MTraceFilter filter = {};
+static TraceFile trace = {};
+
+static bool in_range(const Range *r, int n, vaddr_t lo, vaddr_t hi) {
+  if (n == 0) return true;
+  for (int i = 0; i < n; i ++) {
+    if (lo < r[i].hi && r[i].lo < hi) return true;
+  }
+  return false;
+}
+
+void mtrace_record(int kind, vaddr_t addr, int len, word_t data) {
+  if (!in_range(filter.addr, filter.nr_addr, addr, addr + len)) return;
+  if (!in_range(filter.pc, filter.nr_pc, cpu.pc, cpu.pc + 1)) return;
+  *(MTraceRec *)trace_file_append(&trace, sizeof(MTraceRec)) = (MTraceRec) {
+    .pc = cpu.pc, .addr = addr, .kind = kind, .len = len,
+    // a store passes the whole register, keep the bytes written
+    IFDEF(CONFIG_MITRACE_VALUE, .data = (len < sizeof(word_t) ? data & ((1ull << (len * 8)) - 1) : data))
+  };
+}
+
+static bool parse_range(const char *s, Range *r) {
+  char *end;
+  r->lo = strtoull(s, &end, 0);
+  if (*end != '-') return false;
+  r->hi = strtoull(end + 1, &end, 0);
+  return *end == '\0' && r->lo < r->hi;
+}
+
+bool mtrace_config(const char *spec) {
+  MTraceFilter f = {};
+  bool off = false;
+  char buf[256];
+  strncpy(buf, spec, sizeof(buf) - 1);
+  buf[sizeof(buf) - 1] = '\0';
+
+  char *save = NULL;
+  for (char *t = strtok_r(buf, " ,", &save); t != NULL; t = strtok_r(NULL, " ,", &save)) {
+    bool ok = true;
+    if (strcmp(t, "off") == 0) off = true;
+    else if (strncmp(t, "addr=", 5) == 0) {
+      ok = f.nr_addr < MAX_RANGE && parse_range(t + 5, &f.addr[f.nr_addr ++]);
+    } else if (strncmp(t, "pc=", 3) == 0) {
+      ok = f.nr_pc < MAX_RANGE && parse_range(t + 3, &f.pc[f.nr_pc ++]);
+    } else {
+      for (char *c = t; *c && ok; c ++) {
+        switch (*c) {
+          case 'r': f.kind |= MTRACE_READ; break;
+          case 'w': f.kind |= MTRACE_WRITE; break;
+          case 'x': f.kind |= MTRACE_FETCH; break;
+          default: ok = false;
+        }
+      }
+    }
+    if (!ok) {
+      printf("Bad mtrace filter term '%s'\n", t);
+      return false;
+    }
+  }
+
+  if (f.kind == 0) f.kind = MTRACE_READ | MTRACE_WRITE;
+  filter = f;
+  g_mtrace_kind = (off ? 0 : f.kind);
+  return true;
+}
+
+void init_mtrace(const char *spec) {
+  const char *path = CONFIG_MITRACE_PATH;
+  trace_file_open(&trace, path, MTRACE_MAGIC,
+      MUXDEF(CONFIG_MITRACE_VALUE, 1, 0), sizeof(MTraceRec));
+  if (spec == NULL) spec = CONFIG_MITRACE_FILTER;
+  bool ok = mtrace_config(spec);
+  Assert(ok, "Bad mtrace filter '%s'", spec);
+  Log("Memory access trace with filter '%s' is written to %s", spec, path);
+}
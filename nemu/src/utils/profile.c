@@ -0,0 +1,174 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+#include <utils.h>
+
+// The guest pc is sampled every CONFIG_PROFILER_INTERVAL instructions.
+// Each sample's call stack is interned into a tree of (caller, function)
+// nodes, so a sample costs one hash probe per frame and no allocation
+// once the stack has been seen before.
+
+#define INTERVAL CONFIG_PROFILER_INTERVAL
+#define PROFILE_PATH CONFIG_PROFILER_PATH
+#define TABLE_PATH CONFIG_PROFILER_PATH ".table"
+
+typedef struct {
+  int parent;     // node index, node 0 is the root
+  int func;       // symbol index, -1 for an unknown function
+  uint64_t count; // samples whose stack ends at this node
+} ProfNode;
+
+uint64_t g_prof_next = INTERVAL;
+
+static ProfNode *node = NULL;
+static int nr_node = 0, node_cap = 0;
+static int *hash = NULL; // node index + 1, 0 for an empty slot
+static uint32_t hash_size = 0;
+
+static uint32_t hash_of(int parent, int func) {
+  return ((uint32_t)parent * 0x9e3779b1u) ^ ((uint32_t)func * 0x85ebca6bu);
+}
+
+static void rehash() {
+  hash_size *= 2;
+  free(hash);
+  hash = calloc(hash_size, sizeof(int));
+  assert(hash);
+  for (int n = 1; n < nr_node; n ++) {
+    uint32_t h = hash_of(node[n].parent, node[n].func) & (hash_size - 1);
+    while (hash[h] != 0) h = (h + 1) & (hash_size - 1);
+    hash[h] = n + 1;
+  }
+}
+
+static int child(int parent, int func) {
+  if ((uint32_t)nr_node * 2 >= hash_size) rehash();
+  uint32_t h = hash_of(parent, func) & (hash_size - 1);
+  for (; hash[h] != 0; h = (h + 1) & (hash_size - 1)) {
+    ProfNode *p = &node[hash[h] - 1];
+    if (p->parent == parent && p->func == func) return hash[h] - 1;
+  }
+
+  if (nr_node == node_cap) {
+    node_cap *= 2;
+    node = realloc(node, sizeof(ProfNode) * node_cap);
+    assert(node);
+  }
+  node[nr_node] = (ProfNode){ .parent = parent, .func = func, .count = 0 };
+  hash[h] = nr_node + 1;
+  return nr_node ++;
+}
+
+void profile_sample(vaddr_t pc) {
+  g_prof_next += INTERVAL;
+  int n = 0;
+#ifdef CONFIG_PROFILER_CALL_STACK
+  const int *frames;
+  int depth = ftrace_call_stack(&frames);
+  for (int i = 0; i < depth; i ++) n = child(n, frames[i]);
+#endif
+  // the innermost frame is normally the function containing pc, unless
+  // it was entered without a call
+  int func = ftrace_find_func(pc);
+  if (n == 0 || node[n].func != func) n = child(n, func);
+  node[n].count ++;
+}
+
+static void write_folded() {
+  FILE *fp = fopen(PROFILE_PATH, "w");
+  if (fp == NULL) { perror(PROFILE_PATH); return; }
+  int *path = malloc(sizeof(int) * nr_node);
+  assert(path);
+  for (int n = 1; n < nr_node; n ++) {
+    if (node[n].count == 0) continue;
+    int depth = 0;
+    for (int p = n; p != 0; p = node[p].parent) path[depth ++] = node[p].func;
+    for (int i = depth - 1; i >= 0; i --) {
+      fprintf(fp, "%s%c", ftrace_func_name(path[i]), i == 0 ? ' ' : ';');
+    }
+    fprintf(fp, "%" PRIu64 "\n", node[n].count);
+  }
+  free(path);
+  fclose(fp);
+}
+
+typedef struct {
+  int func;
+  uint64_t self, total;
+  int seen; // the last node counted into total, so recursion counts once
+} ProfFunc;
+
+static int func_cmp(const void *a, const void *b) {
+  const ProfFunc *x = a, *y = b;
+  if (x->self != y->self) return x->self < y->self ? 1 : -1;
+  return x->total < y->total ? 1 : (x->total > y->total ? -1 : 0);
+}
+
+static void write_table(uint64_t nr_sample) {
+  FILE *fp = fopen(TABLE_PATH, "w");
+  if (fp == NULL) { perror(TABLE_PATH); return; }
+  // slot 0 is for unknown functions
+  int nr_func = ftrace_nr_func() + 1;
+  ProfFunc *f = calloc(nr_func, sizeof(ProfFunc));
+  assert(f);
+  for (int i = 0; i < nr_func; i ++) { f[i].func = i - 1; f[i].seen = -1; }
+
+  for (int n = 1; n < nr_node; n ++) {
+    uint64_t c = node[n].count;
+    if (c == 0) continue;
+    f[node[n].func + 1].self += c;
+    for (int p = n; p != 0; p = node[p].parent) {
+      ProfFunc *e = &f[node[p].func + 1];
+      if (e->seen != n) { e->seen = n; e->total += c; }
+    }
+  }
+  qsort(f, nr_func, sizeof(ProfFunc), func_cmp);
+
+  fprintf(fp, "%" PRIu64 " samples, one every %d instructions\n", nr_sample, INTERVAL);
+  fprintf(fp, "%7s %16s %7s %16s  %s\n", "self%", "self inst", "total%", "total inst", "function");
+  for (int i = 0; i < nr_func && f[i].total > 0; i ++) {
+    fprintf(fp, "%6.2f%% %16" PRIu64 " %6.2f%% %16" PRIu64 "  %s\n",
+        100.0 * f[i].self / nr_sample, f[i].self * INTERVAL,
+        100.0 * f[i].total / nr_sample, f[i].total * INTERVAL,
+        ftrace_func_name(f[i].func));
+  }
+  free(f);
+  fclose(fp);
+}
+
+static void profile_dump() {
+  uint64_t nr_sample = 0;
+  for (int n = 1; n < nr_node; n ++) nr_sample += node[n].count;
+  if (nr_sample == 0) return;
+  write_folded();
+  write_table(nr_sample);
+  Log("Profile of %" PRIu64 " samples is written to " PROFILE_PATH " and " TABLE_PATH, nr_sample);
+}
+
+void init_profiler() {
+  if (ftrace_nr_func() == 0) {
+    Log("No function symbols for the profiler, give the guest ELF with --elf");
+  }
+  node_cap = 1024;
+  node = malloc(sizeof(ProfNode) * node_cap);
+  assert(node);
+  node[0] = (ProfNode){ .parent = -1, .func = -1, .count = 0 };
+  nr_node = 1;
+  hash_size = 2048;
+  hash = calloc(hash_size, sizeof(int));
+  assert(hash);
+  atexit(profile_dump);
+}
@@ -0,0 +1,71 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#define _GNU_SOURCE  // for mremap()
+#include <utils.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// A trace file is mapped into memory and grows by CHUNK_SIZE bytes
+// whenever it is full, so a record costs a few stores. The file is cut
+// to its real length at exit.
+
+#define CHUNK_SIZE (64 << 20)
+#define MAX_TRACE_FILE 4
+
+static TraceFile *opened[MAX_TRACE_FILE];
+static int nr_opened = 0;
+
+void trace_file_grow(TraceFile *f) {
+  size_t cap = f->cap + CHUNK_SIZE;
+  int ret = ftruncate(f->fd, cap);
+  Assert(ret == 0, "Can not grow the trace file");
+  f->buf = (f->buf == NULL ?
+      mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, f->fd, 0) :
+      mremap(f->buf, f->cap, cap, MREMAP_MAYMOVE));
+  Assert(f->buf != MAP_FAILED, "Can not map the trace file");
+  f->cap = cap;
+}
+
+static void trace_file_finish() {
+  for (int i = 0; i < nr_opened; i ++) {
+    TraceFile *f = opened[i];
+    munmap(f->buf, f->cap);
+    if (ftruncate(f->fd, f->len) != 0) perror("ftruncate");
+    close(f->fd);
+  }
+}
+
+void trace_file_open(TraceFile *f, const char *path, const char *magic,
+    uint32_t has_value, uint32_t rec_size) {
+  assert(nr_opened < MAX_TRACE_FILE);
+  f->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  Assert(f->fd >= 0, "Can not open %s", path);
+  f->buf = NULL;
+  f->cap = 0;
+  trace_file_grow(f);
+  f->len = sizeof(TraceHeader);
+
+  TraceHeader *hdr = (TraceHeader *)f->buf;
+  memcpy(hdr->magic, magic, sizeof(hdr->magic));
+  strncpy(hdr->isa, str(__GUEST_ISA__), sizeof(hdr->isa) - 1);
+  hdr->xlen = sizeof(word_t);
+  hdr->has_value = has_value;
+  hdr->rec_size = rec_size;
+  hdr->nr_rec = 0;
+  if (nr_opened == 0) atexit(trace_file_finish);
+  opened[nr_opened ++] = f;
+}
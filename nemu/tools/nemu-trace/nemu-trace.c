@@ -0,0 +1,242 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// Decode the binary instruction trace written by NEMU with
+// CONFIG_ITRACE_BINARY and disassemble it, or decode the memory access
+// trace written with CONFIG_MITRACE. See include/cpu/itrace.h.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <getopt.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cpu/itrace.h>
+
+void init_disasm(const char *triple);
+void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
+
+typedef struct {
+  uint64_t addr, size;
+  const char *name;
+} Symbol;
+
+static Symbol *syms = NULL;
+static int nr_sym = 0;
+
+static bool is_riscv = false;
+static bool do_disasm = true;
+static uint64_t skip = 0, count = UINT64_MAX;
+
+static const char *riscv_reg[] = {
+  "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+  "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+  "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+  "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+static void usage(const char *name) {
+  printf("Usage: %s [OPTION...] TRACE\n\n", name);
+  printf("\t-e,--elf=FILE           show the function of each instruction\n");
+  printf("\t-s,--skip=N             skip the first N records\n");
+  printf("\t-c,--count=N            print at most N records\n");
+  printf("\t-n,--no-disasm          do not disassemble\n");
+  printf("\n");
+  exit(0);
+}
+
+static void *map_file(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) { perror(path); exit(1); }
+  struct stat st;
+  assert(fstat(fd, &st) == 0);
+  *size = st.st_size;
+  void *p = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) { perror(path); exit(1); }
+  close(fd);
+  return p;
+}
+
+static int sym_cmp(const void *a, const void *b) {
+  const Symbol *x = a, *y = b;
+  return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+#define LOAD_SYMBOLS(bits) do { \
+  Elf##bits##_Ehdr *eh = (void *)elf; \
+  Elf##bits##_Shdr *sh = (void *)(elf + eh->e_shoff); \
+  for (int i = 0; i < eh->e_shnum; i ++) { \
+    if (sh[i].sh_type != SHT_SYMTAB) continue; \
+    Elf##bits##_Sym *sym = (void *)(elf + sh[i].sh_offset); \
+    const char *strtab = (const char *)elf + sh[sh[i].sh_link].sh_offset; \
+    int n = sh[i].sh_size / sizeof(*sym); \
+    syms = realloc(syms, sizeof(Symbol) * (nr_sym + n)); \
+    for (int j = 0; j < n; j ++) { \
+      if (ELF##bits##_ST_TYPE(sym[j].st_info) != STT_FUNC) continue; \
+      syms[nr_sym ++] = (Symbol) { sym[j].st_value, sym[j].st_size, strtab + sym[j].st_name }; \
+    } \
+  } \
+} while (0)
+
+static void load_elf(const char *path) {
+  size_t size;
+  uint8_t *elf = map_file(path, &size);
+  if (size < EI_NIDENT || memcmp(elf, ELFMAG, SELFMAG) != 0) {
+    fprintf(stderr, "%s is not an ELF file\n", path);
+    exit(1);
+  }
+  if (elf[EI_CLASS] == ELFCLASS32) LOAD_SYMBOLS(32);
+  else LOAD_SYMBOLS(64);
+  qsort(syms, nr_sym, sizeof(Symbol), sym_cmp);
+}
+
+static const Symbol *find_symbol(uint64_t pc) {
+  // the last symbol starting at or below pc
+  int l = 0, r = nr_sym;
+  while (l < r) {
+    int mid = (l + r) / 2;
+    if (syms[mid].addr <= pc) l = mid + 1;
+    else r = mid;
+  }
+  if (l == 0) return NULL;
+  const Symbol *s = &syms[l - 1];
+  return (pc < s->addr + s->size || s->size == 0 ? s : NULL);
+}
+
+static bool riscv_writes_rd(uint32_t inst) {
+  uint32_t rd = (inst >> 7) & 0x1f;
+  if (rd == 0) return false;
+  switch (inst & 0x7f) {
+    case 0x03: case 0x13: case 0x17: case 0x1b: case 0x33:
+    case 0x37: case 0x3b: case 0x67: case 0x6f: return true;
+    case 0x73: return ((inst >> 12) & 0x7) != 0;  // csr*
+    default: return false;
+  }
+}
+
+static const char *triple(const char *isa) {
+  static char buf[64];
+  const char *arch = isa;
+  if (strcmp(isa, "x86") == 0) arch = "i686";
+  else if (strcmp(isa, "mips32") == 0) arch = "mipsel";
+  snprintf(buf, sizeof(buf), "%s-pc-linux-gnu", arch);
+  return buf;
+}
+
+static void print_function(uint64_t pc) {
+  static const Symbol *last = NULL;
+  if (nr_sym > 0) {
+    const Symbol *s = find_symbol(pc);
+    if (s != last) {
+      if (s != NULL) printf("<%s>:\n", s->name);
+      else printf("<unknown>:\n");
+      last = s;
+    }
+  }
+}
+
+static void print_record(const TraceHeader *hdr, const uint8_t *p) {
+  uint64_t pc = 0, rd = 0;
+  uint32_t inst;
+  memcpy(&pc, p, hdr->xlen);
+  memcpy(&inst, p + hdr->xlen, 4);
+  if (hdr->has_value) memcpy(&rd, p + hdr->xlen + 4, hdr->xlen);
+  print_function(pc);
+
+  int w = hdr->xlen * 2;
+  char line[256];
+  int len = snprintf(line, sizeof(line), "  %0*lx:  %08x", w, pc, inst);
+  if (do_disasm) {
+    char buf[128];
+    disassemble(buf, sizeof(buf), pc, (uint8_t *)&inst, 4);
+    char *operand = strchr(buf, '\t');
+    if (operand != NULL) *operand ++ = '\0';
+    len += snprintf(line + len, sizeof(line) - len, "  %-8s%s", buf, operand ? operand : "");
+  }
+  if (hdr->has_value && is_riscv && riscv_writes_rd(inst)) {
+    printf("%-56s# %s = 0x%0*lx\n", line, riscv_reg[(inst >> 7) & 0x1f], w, rd);
+  } else puts(line);
+}
+
+static void print_mem_record(const TraceHeader *hdr, const uint8_t *p) {
+  uint64_t pc = 0, addr = 0, data = 0;
+  memcpy(&pc, p, hdr->xlen);
+  memcpy(&addr, p + hdr->xlen, hdr->xlen);
+  uint8_t kind = p[hdr->xlen * 2], len = p[hdr->xlen * 2 + 1];
+  if (hdr->has_value) memcpy(&data, p + hdr->xlen * 2 + 2, hdr->xlen);
+  print_function(pc);
+
+  int w = hdr->xlen * 2;
+  printf("  %0*lx:  %s  %0*lx  %d", w, pc,
+      kind == MTRACE_WRITE ? "W" : (kind == MTRACE_FETCH ? "X" : "R"), w, addr, len);
+  if (hdr->has_value) printf("  0x%0*lx", len * 2, data);
+  printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+  const struct option table[] = {
+    {"elf"      , required_argument, NULL, 'e'},
+    {"skip"     , required_argument, NULL, 's'},
+    {"count"    , required_argument, NULL, 'c'},
+    {"no-disasm", no_argument      , NULL, 'n'},
+    {"help"     , no_argument      , NULL, 'h'},
+    {0          , 0                , NULL,  0 },
+  };
+  const char *elf = NULL;
+  int o;
+  while ((o = getopt_long(argc, argv, "e:s:c:nh", table, NULL)) != -1) {
+    switch (o) {
+      case 'e': elf = optarg; break;
+      case 's': skip = strtoull(optarg, NULL, 0); break;
+      case 'c': count = strtoull(optarg, NULL, 0); break;
+      case 'n': do_disasm = false; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) usage(argv[0]);
+  const char *path = argv[optind];
+
+  size_t size;
+  uint8_t *trace = map_file(path, &size);
+  const TraceHeader *hdr = (const TraceHeader *)trace;
+  bool is_mtrace = (size >= sizeof(*hdr) && memcmp(hdr->magic, MTRACE_MAGIC, sizeof(hdr->magic)) == 0);
+  if (size < sizeof(*hdr) || (!is_mtrace &&
+        memcmp(hdr->magic, ITRACE_MAGIC, sizeof(hdr->magic)) != 0)) {
+    fprintf(stderr, "%s is not a NEMU trace\n", path);
+    return 1;
+  }
+  uint64_t nr_rec = (size - sizeof(*hdr)) / hdr->rec_size;
+  if (hdr->nr_rec < nr_rec) nr_rec = hdr->nr_rec;
+
+  char isa[sizeof(hdr->isa) + 1] = {};
+  memcpy(isa, hdr->isa, sizeof(hdr->isa));
+  is_riscv = (strncmp(isa, "riscv", 5) == 0);
+  if (is_mtrace) do_disasm = false;
+  if (do_disasm) init_disasm(triple(isa));
+  if (elf != NULL) load_elf(elf);
+
+  const uint8_t *p = trace + sizeof(*hdr);
+  for (uint64_t i = skip; i < nr_rec && i - skip < count; i ++) {
+    if (is_mtrace) print_mem_record(hdr, p + i * hdr->rec_size);
+    else print_record(hdr, p + i * hdr->rec_size);
+  }
+  return 0;
+}
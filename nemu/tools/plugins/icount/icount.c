@@ -0,0 +1,74 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <nemu-plugin.h>
+
+// An example plugin counting events.
+// Usage: --plugin=icount-so[,mem][,block][,trap]
+// Instructions are always counted; the other classes only when asked for,
+// so NEMU does not pay for the callbacks otherwise.
+
+NEMU_PLUGIN_EXPORT const uint32_t nemu_plugin_version = NEMU_PLUGIN_VERSION;
+
+static uint64_t nr_inst = 0, nr_block = 0, nr_trap = 0;
+static uint64_t nr_mem[3] = {}; // read, write, fetch
+
+static void count_inst(void *udata, uint64_t pc, const uint8_t *inst, int len) {
+  nr_inst ++;
+}
+
+static void count_mem(void *udata, uint64_t pc, uint64_t addr, int len, int kind, uint64_t data) {
+  nr_mem[kind == NEMU_MEM_READ ? 0 : (kind == NEMU_MEM_WRITE ? 1 : 2)] ++;
+}
+
+static void count_block(void *udata, uint64_t pc) {
+  nr_block ++;
+}
+
+static void count_trap(void *udata, uint64_t pc, uint64_t cause, uint64_t handler) {
+  nr_trap ++;
+}
+
+static void count_exit(void *udata, int state, uint32_t halt_ret, uint64_t nr) {
+  FILE *fp = stderr;
+  fprintf(fp, "icount: %" PRIu64 " instructions (NEMU counts %" PRIu64 ")\n", nr_inst, nr);
+  if (nr_block > 0) fprintf(fp, "icount: %" PRIu64 " blocks, %.2f instructions per block\n",
+      nr_block, (double)nr_inst / nr_block);
+  if (nr_mem[0] + nr_mem[1] + nr_mem[2] > 0) {
+    fprintf(fp, "icount: %" PRIu64 " reads, %" PRIu64 " writes, %" PRIu64 " fetches\n",
+        nr_mem[0], nr_mem[1], nr_mem[2]);
+  }
+  if (nr_trap > 0) fprintf(fp, "icount: %" PRIu64 " traps\n", nr_trap);
+}
+
+int nemu_plugin_install(const NemuPluginAPI *api, const char *args) {
+  api->register_inst(count_inst, NULL);
+  api->register_exit(count_exit, NULL);
+
+  char *buf = strdup(args);
+  for (char *opt = strtok(buf, ","); opt != NULL; opt = strtok(NULL, ",")) {
+    if (strcmp(opt, "mem") == 0) api->register_mem(count_mem, NULL);
+    else if (strcmp(opt, "block") == 0) api->register_block(count_block, NULL);
+    else if (strcmp(opt, "trap") == 0) api->register_trap(count_trap, NULL);
+    else { fprintf(stderr, "icount: unknown option '%s'\n", opt); free(buf); return 1; }
+  }
+  free(buf);
+  fprintf(stderr, "icount: loaded into NEMU for %s\n", api->isa);
+  return 0;
+}
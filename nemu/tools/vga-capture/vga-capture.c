@@ -0,0 +1,235 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+// Convert the capture stream written by NEMU with CONFIG_VGA_CAPTURE
+// into a Y4M video or a PNG snapshot. See include/device/vgacap.h.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <getopt.h>
+#include <device/vgacap.h>
+
+static VGACapHeader hdr;
+static uint32_t *fb = NULL;
+static uint8_t *yuv = NULL;
+
+static FILE *y4m_fp = NULL;
+static FILE *png_fp = NULL;
+static long png_frame = -1; // -1 means the last frame
+
+static void usage(const char *name) {
+  printf("Usage: %s [OPTION...] CAPTURE\n\n", name);
+  printf("\t-y,--y4m=FILE           convert the capture to a Y4M video\n");
+  printf("\t-p,--png=FILE           save a frame as PNG\n");
+  printf("\t-f,--frame=N            the frame (counted in ticks) saved by --png, default to the last one\n");
+  printf("\n");
+  exit(0);
+}
+
+static FILE *open_output(const char *path) {
+  FILE *fp = (strcmp(path, "-") == 0 ? stdout : fopen(path, "wb"));
+  if (fp == NULL) { perror(path); exit(1); }
+  return fp;
+}
+
+// ------------------------ Y4M ------------------------
+
+static uint8_t clamp(int x) { return x < 0 ? 0 : (x > 255 ? 255 : x); }
+
+static void y4m_header() {
+  fprintf(y4m_fp, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", hdr.width, hdr.height, hdr.hz);
+}
+
+static void y4m_frame() {
+  int w = hdr.width, h = hdr.height;
+  int cw = (w + 1) / 2, ch = (h + 1) / 2;
+  uint8_t *Y = yuv, *U = Y + w * h, *V = U + cw * ch;
+  for (int y = 0; y < h; y ++) {
+    for (int x = 0; x < w; x ++) {
+      uint32_t p = fb[y * w + x];
+      int r = (p >> 16) & 0xff, g = (p >> 8) & 0xff, b = p & 0xff;
+      Y[y * w + x] = clamp((77 * r + 150 * g + 29 * b) >> 8);
+    }
+  }
+  for (int y = 0; y < ch; y ++) {
+    for (int x = 0; x < cw; x ++) {
+      int r = 0, g = 0, b = 0, n = 0;
+      for (int dy = 0; dy < 2 && 2 * y + dy < h; dy ++) {
+        for (int dx = 0; dx < 2 && 2 * x + dx < w; dx ++) {
+          uint32_t p = fb[(2 * y + dy) * w + 2 * x + dx];
+          r += (p >> 16) & 0xff; g += (p >> 8) & 0xff; b += p & 0xff; n ++;
+        }
+      }
+      r /= n; g /= n; b /= n;
+      U[y * cw + x] = clamp(((-43 * r - 85 * g + 128 * b) >> 8) + 128);
+      V[y * cw + x] = clamp(((128 * r - 107 * g - 21 * b) >> 8) + 128);
+    }
+  }
+  fputs("FRAME\n", y4m_fp);
+  fwrite(yuv, w * h + 2 * cw * ch, 1, y4m_fp);
+}
+
+// ------------------------ PNG ------------------------
+// The image data is stored with uncompressed deflate blocks,
+// so that no external library is needed.
+
+static uint32_t crc_table[256];
+
+static void init_crc_table() {
+  for (uint32_t n = 0; n < 256; n ++) {
+    uint32_t c = n;
+    for (int k = 0; k < 8; k ++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    crc_table[n] = c;
+  }
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i ++) crc = crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+static void put_be32(uint8_t *p, uint32_t x) {
+  p[0] = x >> 24; p[1] = x >> 16; p[2] = x >> 8; p[3] = x;
+}
+
+static void png_chunk(const char *type, const uint8_t *data, uint32_t len) {
+  uint8_t b[4];
+  put_be32(b, len);
+  fwrite(b, 4, 1, png_fp);
+  fwrite(type, 4, 1, png_fp);
+  if (len > 0) fwrite(data, len, 1, png_fp);
+  uint32_t crc = crc_update(0xffffffffu, (const uint8_t *)type, 4);
+  crc = crc_update(crc, data, len) ^ 0xffffffffu;
+  put_be32(b, crc);
+  fwrite(b, 4, 1, png_fp);
+}
+
+static void png_write() {
+  int w = hdr.width, h = hdr.height;
+  size_t raw_len = (size_t)h * (1 + 3 * w);
+  uint8_t *raw = malloc(raw_len);
+  assert(raw);
+  uint8_t *p = raw;
+  for (int y = 0; y < h; y ++) {
+    *p ++ = 0; // filter: none
+    for (int x = 0; x < w; x ++) {
+      uint32_t c = fb[y * w + x];
+      *p ++ = c >> 16; *p ++ = c >> 8; *p ++ = c;
+    }
+  }
+
+  size_t nr_block = (raw_len + 65534) / 65535;
+  size_t z_len = 2 + nr_block * 5 + raw_len + 4;
+  uint8_t *z = malloc(z_len), *q = z;
+  assert(z);
+  *q ++ = 0x78; *q ++ = 0x01;
+  uint32_t a = 1, b = 0;
+  for (size_t off = 0; off < raw_len; off += 65535) {
+    size_t n = raw_len - off < 65535 ? raw_len - off : 65535;
+    *q ++ = (off + n == raw_len);
+    *q ++ = n; *q ++ = n >> 8; *q ++ = ~n; *q ++ = (~n) >> 8;
+    memcpy(q, raw + off, n);
+    q += n;
+    for (size_t i = 0; i < n; i ++) { a = (a + raw[off + i]) % 65521; b = (b + a) % 65521; }
+  }
+  put_be32(q, (b << 16) | a);
+
+  uint8_t ihdr[13];
+  put_be32(ihdr, w);
+  put_be32(ihdr + 4, h);
+  ihdr[8] = 8; ihdr[9] = 2; ihdr[10] = ihdr[11] = ihdr[12] = 0; // 8-bit RGB
+  fwrite("\x89PNG\r\n\x1a\n", 8, 1, png_fp);
+  png_chunk("IHDR", ihdr, sizeof(ihdr));
+  png_chunk("IDAT", z, z_len);
+  png_chunk("IEND", NULL, 0);
+  free(raw);
+  free(z);
+}
+
+// ------------------------ main ------------------------
+
+int main(int argc, char *argv[]) {
+  const struct option table[] = {
+    {"y4m"      , required_argument, NULL, 'y'},
+    {"png"      , required_argument, NULL, 'p'},
+    {"frame"    , required_argument, NULL, 'f'},
+    {"help"     , no_argument      , NULL, 'h'},
+    {0          , 0                , NULL,  0 },
+  };
+  int o;
+  while ( (o = getopt_long(argc, argv, "y:p:f:h", table, NULL)) != -1) {
+    switch (o) {
+      case 'y': y4m_fp = open_output(optarg); break;
+      case 'p': png_fp = open_output(optarg); break;
+      case 'f': png_frame = atol(optarg); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || (y4m_fp == NULL && png_fp == NULL)) usage(argv[0]);
+
+  const char *path = argv[optind];
+  FILE *fp = (strcmp(path, "-") == 0 ? stdin : fopen(path, "rb"));
+  if (fp == NULL) { perror(path); return 1; }
+  if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, VGACAP_MAGIC, sizeof(hdr.magic)) != 0) {
+    fprintf(stderr, "%s is not a NEMU VGA capture\n", path);
+    return 1;
+  }
+
+  fb = calloc((size_t)hdr.width * hdr.height, sizeof(uint32_t));
+  yuv = malloc((size_t)hdr.width * hdr.height * 2);
+  assert(fb && yuv);
+  init_crc_table();
+  if (y4m_fp) y4m_header();
+
+  VGACapFrame f;
+  uint32_t last_tick = 0;
+  long nr_record = 0;
+  bool png_done = false;
+  while (fread(&f, sizeof(f), 1, fp) == 1) {
+    // the previous frame lasts until this one
+    if (nr_record > 0 && y4m_fp) {
+      for (uint32_t t = last_tick; t < f.tick; t ++) y4m_frame();
+    }
+    if (png_fp && !png_done && png_frame >= 0 && nr_record > 0 && f.tick > png_frame) {
+      png_write();
+      png_done = true;
+    }
+
+    for (uint32_t i = 0; i < f.nr_span; i ++) {
+      VGACapSpan s;
+      if (fread(&s, sizeof(s), 1, fp) != 1 || s.first_row + s.nr_row > hdr.height ||
+          fread(fb + (size_t)s.first_row * hdr.width, sizeof(uint32_t) * hdr.width, s.nr_row, fp) != s.nr_row) {
+        fprintf(stderr, "truncated capture at tick %u\n", f.tick);
+        goto end;
+      }
+    }
+    last_tick = f.tick;
+    nr_record ++;
+  }
+
+end:
+  if (nr_record > 0 && y4m_fp) y4m_frame();
+  if (png_fp && !png_done) png_write();
+  fprintf(stderr, "%ld frames recorded until tick %u\n", nr_record, last_tick);
+
+  if (y4m_fp) fclose(y4m_fp);
+  if (png_fp) fclose(png_fp);
+  return 0;
+}